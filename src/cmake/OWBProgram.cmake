@@ -0,0 +1,60 @@
+# pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+# Copyright (C) 2024 David "Alemarius Nexus" Lerch
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+# Script for the program target, run with cmake -P at programming time:
+#
+#     cmake -DPDK_DEVICE=<device> -DFIRMWARE=<image> [-DOWB_ROM_CODE=<code>]
+#           [-DOWB_FAMILY_CODE=<family> (-DOWB_SERIAL=<serial> | -DOWB_SERIAL_COUNTER_FILE=<file>)]
+#           -P OWBProgram.cmake
+#
+# With OWB_SERIAL_COUNTER_FILE, the serial number is read from the file and incremented after each successful write,
+# so that a batch of devices can be programmed with unique ROM codes by simply running the target repeatedly.
+
+include("${CMAKE_CURRENT_LIST_DIR}/OWBROMCode.cmake")
+
+set(rom_code "")
+set(counter "")
+if(OWB_ROM_CODE)
+    set(rom_code "${OWB_ROM_CODE}")
+elseif(NOT OWB_FAMILY_CODE STREQUAL ""  AND  OWB_SERIAL_COUNTER_FILE)
+    owb_read_serial_counter(counter "${OWB_SERIAL_COUNTER_FILE}")
+    owb_format_hex(serial "${counter}" 12)
+    owb_make_rom_code(rom_code "${OWB_FAMILY_CODE}" "${serial}")
+elseif(NOT OWB_FAMILY_CODE STREQUAL ""  AND  NOT OWB_SERIAL STREQUAL "")
+    owb_make_rom_code(rom_code "${OWB_FAMILY_CODE}" "${OWB_SERIAL}")
+endif()
+
+set(serial_opts "")
+if(rom_code)
+    owb_check_rom_code("${rom_code}")
+    set(serial_opts -s "0x${rom_code}")
+    message(STATUS "Using 1-Wire ROM code ${rom_code}")
+endif()
+
+execute_process(
+        COMMAND easypdkprog -n "${PDK_DEVICE}" ${serial_opts} write "${FIRMWARE}"
+        RESULT_VARIABLE result
+        )
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "easypdkprog failed")
+endif()
+
+if(NOT counter STREQUAL "")
+    math(EXPR counter "${counter} + 1")
+    file(WRITE "${OWB_SERIAL_COUNTER_FILE}" "${counter}\n")
+    message(STATUS "Next serial number: ${counter}")
+endif()
@@ -0,0 +1,178 @@
+# pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+# Copyright (C) 2024 David "Alemarius Nexus" Lerch
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+# Helpers for generating and checking 64-bit 1-Wire ROM codes. Usable both from CMakeLists.txt and in script mode.
+#
+# ROM codes are handled as 16 hex digits without prefix, in the format expected by easypdkprog -s: a 64-bit number
+# whose least significant byte is byte 0 of the ROM code (family code), and whose most significant byte is byte 7
+# (CRC8 of bytes 0-6). Bytes 1-6 are the 48-bit serial number.
+
+# Dallas/Maxim CRC8 (polynomial x^8 + x^5 + x^4 + 1) over a list of byte values
+function(owb_crc8 out_var)
+    set(crc 0)
+    foreach(byte IN LISTS ARGN)
+        foreach(bit RANGE 7)
+            math(EXPR mix "(${crc} ^ ${byte}) & 1")
+            math(EXPR crc "${crc} >> 1")
+            if(mix)
+                math(EXPR crc "${crc} ^ 0x8C")
+            endif()
+            math(EXPR byte "${byte} >> 1")
+        endforeach()
+    endforeach()
+    set(${out_var} ${crc} PARENT_SCOPE)
+endfunction()
+
+# Format a value as a zero-padded hex string with the given number of digits
+function(owb_format_hex out_var value digits)
+    set(hex "")
+    foreach(i RANGE 1 ${digits})
+        math(EXPR nibble "${value} & 0xF")
+        string(SUBSTRING "0123456789ABCDEF" ${nibble} 1 c)
+        string(PREPEND hex "${c}")
+        math(EXPR value "${value} >> 4")
+    endforeach()
+    set(${out_var} "${hex}" PARENT_SCOPE)
+endfunction()
+
+# Split a ROM code into a list of its 8 byte values, byte 0 (family code) first
+function(owb_rom_code_bytes out_var rom_code)
+    string(LENGTH "${rom_code}" len)
+    if(NOT len EQUAL 16  OR  NOT rom_code MATCHES "^[0-9A-Fa-f]+$")
+        message(FATAL_ERROR "Invalid 1-Wire ROM code '${rom_code}': Must be exactly 16 hex digits.")
+    endif()
+    set(bytes "")
+    foreach(i RANGE 7)
+        math(EXPR pos "14 - 2*${i}")
+        string(SUBSTRING "${rom_code}" ${pos} 2 byte_hex)
+        math(EXPR byte "0x${byte_hex}")
+        list(APPEND bytes ${byte})
+    endforeach()
+    set(${out_var} ${bytes} PARENT_SCOPE)
+endfunction()
+
+# Build a ROM code from a family code (2 hex digits) and a 48-bit serial number (up to 12 hex digits, with or without
+# 0x prefix), appending the CRC8.
+function(owb_make_rom_code out_var family serial)
+    string(REGEX REPLACE "^0[xX]" "" serial_digits "${serial}")
+    if(NOT serial_digits MATCHES "^[0-9A-Fa-f]+$")
+        message(FATAL_ERROR "Invalid 1-Wire serial number '${serial}': Must be hex digits.")
+    endif()
+    string(REGEX REPLACE "^0+(.)" "\\1" serial_digits "${serial_digits}")
+    string(LENGTH "${serial_digits}" len)
+    if(len GREATER 12)
+        message(FATAL_ERROR "1-Wire serial number '${serial}' doesn't fit into 48 bits")
+    endif()
+    math(EXPR serial_value "0x${serial_digits}")
+    math(EXPR family_value "0x${family}")
+    if(family_value LESS 0  OR  family_value GREATER 255)
+        message(FATAL_ERROR "Invalid 1-Wire family code '${family}'")
+    endif()
+
+    set(bytes ${family_value})
+    foreach(i RANGE 5)
+        math(EXPR byte "(${serial_value} >> (8*${i})) & 0xFF")
+        list(APPEND bytes ${byte})
+    endforeach()
+    owb_crc8(crc ${bytes})
+
+    owb_format_hex(crc_hex ${crc} 2)
+    owb_format_hex(serial_hex ${serial_value} 12)
+    owb_format_hex(family_hex ${family_value} 2)
+    set(${out_var} "${crc_hex}${serial_hex}${family_hex}" PARENT_SCOPE)
+endfunction()
+
+# Fail if the ROM code's CRC8 is wrong, and warn about suspicious family codes
+function(owb_check_rom_code rom_code)
+    owb_rom_code_bytes(bytes "${rom_code}")
+    list(GET bytes 7 crc)
+    list(SUBLIST bytes 0 7 data)
+    owb_crc8(expected_crc ${data})
+    if(NOT crc EQUAL expected_crc)
+        owb_format_hex(expected_hex ${expected_crc} 2)
+        message(FATAL_ERROR "1-Wire ROM code ${rom_code} has an invalid CRC8: Most significant byte should be "
+                "${expected_hex}. Masters will keep retrying SEARCH ROM for such a device.")
+    endif()
+
+    list(GET bytes 0 family)
+    if(family EQUAL 0  OR  family EQUAL 255)
+        message(WARNING "1-Wire ROM code ${rom_code} has an unusual family code (byte 0).")
+    endif()
+endfunction()
+
+# Read the serial number from a counter file (decimal, created with 1 if missing). Convert it with owb_format_hex()
+# before passing it to owb_make_rom_code().
+function(owb_read_serial_counter out_var counter_file)
+    if(EXISTS "${counter_file}")
+        file(STRINGS "${counter_file}" counter LIMIT_COUNT 1)
+        string(STRIP "${counter}" counter)
+    else()
+        set(counter 1)
+    endif()
+    if(NOT counter MATCHES "^[0-9]+$")
+        message(FATAL_ERROR "Invalid serial number counter '${counter}' in ${counter_file}")
+    endif()
+    if(counter GREATER 281474976710655)
+        message(FATAL_ERROR "Serial number counter ${counter} in ${counter_file} doesn't fit into 48 bits")
+    endif()
+    set(${out_var} ${counter} PARENT_SCOPE)
+endfunction()
+
+# Write a C header with the ROM codes of virtual slaves (see OWB_VIRTUAL_SLAVES_ENABLED in owb.h), at most 8 of them.
+# The table is transposed: Entry n holds bit n of every ROM code (LSB of byte 0 first), with bit i belonging to virtual
+# slave i. This lets the ISR handle all virtual slaves at once with a single table lookup per bit.
+function(owb_write_virtual_rom_codes header)
+    list(LENGTH ARGN count)
+    if(count EQUAL 0  OR  count GREATER 8)
+        message(FATAL_ERROR "Need between 1 and 8 virtual 1-Wire ROM codes, got ${count}.")
+    endif()
+    set(rom_codes "")
+    foreach(rom_code IN LISTS ARGN)
+        owb_check_rom_code("${rom_code}")
+        string(TOUPPER "${rom_code}" rom_code)
+        if(rom_code IN_LIST rom_codes)
+            message(FATAL_ERROR "Duplicate virtual 1-Wire ROM code ${rom_code}")
+        endif()
+        list(APPEND rom_codes "${rom_code}")
+    endforeach()
+
+    set(bit_masks "")
+    foreach(byte_idx RANGE 7)
+        foreach(bit RANGE 7)
+            set(mask 0)
+            set(slave 0)
+            foreach(rom_code IN LISTS rom_codes)
+                owb_rom_code_bytes(bytes "${rom_code}")
+                list(GET bytes ${byte_idx} byte)
+                math(EXPR mask "${mask} | (((${byte} >> ${bit}) & 1) << ${slave})")
+                math(EXPR slave "${slave} + 1")
+            endforeach()
+            owb_format_hex(mask_hex ${mask} 2)
+            list(APPEND bit_masks "0x${mask_hex}")
+        endforeach()
+    endforeach()
+    string(REPLACE ";" ", " bit_masks "${bit_masks}")
+    string(REPLACE ";" " " rom_codes "${rom_codes}")
+
+    file(CONFIGURE OUTPUT "${header}" CONTENT
+"// Generated by cmake/OWBROMCode.cmake for the ROM codes ${rom_codes}. Do not edit.
+#pragma once
+
+#define OWB_VIRTUAL_SLAVE_COUNT     ${count}
+#define OWB_VIRTUAL_ROM_CODE_BITS   ${bit_masks}
+")
+endfunction()
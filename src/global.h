@@ -18,8 +18,11 @@
 
 #pragma once
 
-// 4MHz is barely enough, 8MHz is better, 2MHz is too slow.
+// 4MHz is barely enough, 8MHz is better, 2MHz is too slow. Can be overridden from the build system (see PDK_F_CPU in
+// CMakeLists.txt).
+#ifndef F_CPU
 #define F_CPU 4000000
+#endif
 
 #include <pdk/device.h>
 
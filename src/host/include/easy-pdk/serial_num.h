@@ -0,0 +1,26 @@
+/*
+    pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+    Copyright (C) 2024 David "Alemarius Nexus" Lerch
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Mock of the easy-pdk serial number placeholder for host builds. Instead of being patched by easypdkprog, the serial
+// number is a plain array defined in owb_host.c, so that the host tools can change it at runtime.
+
+#include <stdint.h>
+
+#define EASY_PDK_SERIAL_NUM(sname) extern uint8_t sname[8]
@@ -0,0 +1,86 @@
+/*
+    pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+    Copyright (C) 2024 David "Alemarius Nexus" Lerch
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Mock of the free-pdk device header for host builds. The I/O registers are plain variables (defined in owb_host.c),
+// and only the registers and bits actually used by the 1-Wire code are provided. Bit values follow the PDK14 layout.
+
+#include <stdint.h>
+
+
+#define PA          _pa
+#define PAC         _pac
+#define PADIER      _padier
+#define INTEN       _inten
+#define INTRQ       _intrq
+#define INTEGS      _integs
+#define T16M        _t16m
+#define T16C        _t16c
+#define GPCC        _gpcc
+#define GPCS        _gpcs
+
+extern volatile uint8_t _pa;
+extern volatile uint8_t _pac;
+extern volatile uint8_t _padier;
+extern volatile uint8_t _inten;
+extern volatile uint8_t _intrq;
+extern volatile uint8_t _integs;
+extern volatile uint8_t _t16m;
+extern volatile uint16_t _t16c;
+extern volatile uint8_t _gpcc;
+extern volatile uint8_t _gpcs;
+
+#define INTEN_PA0               0x01
+#define INTEN_T16               0x04
+#define INTEN_COMP              0x10
+
+#define INTRQ_PA0               0x01
+#define INTRQ_T16               0x04
+#define INTRQ_COMP              0x10
+
+#define INTEGS_PA0_RISING       0x01
+#define INTEGS_PA0_FALLING      0x02
+// The comparator's edge selection lives in INTEGS on some devices and in MISC2 on others. Only the former is modeled.
+#define INTEGS_COMP_RISING      0x40
+#define INTEGS_COMP_FALLING     0x80
+
+#define T16M_CLK_DISABLE        0x00
+#define T16M_CLK_SYSCLK         0x20
+#define T16M_CLK_DIV1           0x00
+#define T16M_INTSRC_11BIT       0x03
+#define T16M_INTSRC_13BIT       0x05
+
+#define GPCC_COMP_ENABLE        0x80
+#define GPCC_COMP_OUT_INVERT    0x10
+#define GPCC_COMP_PLUS_VINT_R   0x00
+#define GPCC_COMP_MINUS_PA3     0x00
+#define GPCC_COMP_MINUS_PA4     0x02
+#define GPCC_COMP_MINUS_PB6     0x04
+#define GPCC_COMP_MINUS_PB7     0x06
+
+#define GPCS_COMP_RANGE2        0x20
+#define GPCS_COMP_VOLTAGE_LVL_BIT0  0
+
+// The host model runs the ISR and the main loop in turn, so there is nothing to disable.
+#define __engint()
+#define __disgint()
+// Nothing to wait for either, the next edge is whatever the host feeds in next. OWBHostSlot() delays that edge's ISR by
+// the wake-up time though (see host/owb_host.c).
+extern volatile uint8_t OWBHostStopped;
+#define __stopexe()             (OWBHostStopped = 1)
@@ -0,0 +1,534 @@
+/*
+    pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+    Copyright (C) 2024 David "Alemarius Nexus" Lerch
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Simulates many slaves on one wired-AND bus and enumerates them with the standard SEARCH ROM algorithm of a reference
+// master, reporting the number of slots and the bus time it took.
+//
+// Every slave is a separate copy of the host model module (owb.c and owb_host.c built as a shared object), so all of
+// them run the unmodified state machine with their own globals. Per slot, the bus stays LOW for the master's pulse or
+// until the last slave answering a READ with 0 releases it, whichever is longer, and every slave sees that LOW time
+// measured with its own clock.
+//
+// Timing skew is injected as a deviation of each slave's clock from F_CPU: --skew gives each slave a random deviation
+// within +/- the given percentage, --slave-skew sets it for a single slave. Together with the master timing options,
+// this shows how much margin the OWB_TIMING_* constants leave before enumeration fails.
+
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define OWB_SIM_CMD_SEARCH_ROM      0xF0
+#define OWB_SIM_CMD_OVERDRIVE_SKIP  0x3C
+
+#define OWB_HOST_SLOT_PRESENCE      0x02
+
+
+// Master timing in microseconds. Slot and RstSlot are the full length of a slot including recovery time.
+typedef struct
+{
+    double W1Low;
+    double W0Low;
+    double RLow;
+    double RSample;
+    double Slot;
+    double RstLow;
+    double RstSlot;
+} MasterTiming;
+
+static MasterTiming StandardTiming = { 6, 60, 6, 15, 70, 480, 960 };
+static MasterTiming OverdriveTiming = { 1, 7.5, 1, 2, 10, 70, 140 };
+
+typedef struct
+{
+    void* Module;
+    uint8_t* ROMCode;
+    void (*Init)(void);
+    uint8_t (*Slot)(uint16_t lowTicks);
+    uint16_t (*Read0ReleaseTicks)(void);
+
+    // Clock of this slave in ticks per microsecond
+    double TicksPerUs;
+    double Skew;
+    bool FixedSkew;
+} Slave;
+
+typedef struct
+{
+    uint64_t Slots;
+    uint64_t Resets;
+    double BusTimeUs;
+} BusCounters;
+
+
+static Slave* Slaves;
+static int NumSlaves;
+static uint8_t (*ROMCodes)[8];
+
+static const MasterTiming* Timing = &StandardTiming;
+static BusCounters Counters;
+
+static uint64_t RandomState = 1;
+
+
+static uint64_t Random(void)
+{
+    // xorshift64*, so that results are reproducible for a given --seed on every platform
+    RandomState ^= RandomState >> 12;
+    RandomState ^= RandomState << 25;
+    RandomState ^= RandomState >> 27;
+    return RandomState * 0x2545F4914F6CDD1DULL;
+}
+
+static double RandomUniform(double min, double max)
+{
+    return min + (max-min) * ((double) (Random() >> 11) / (double) (1ULL << 53));
+}
+
+static uint8_t CRC8(const uint8_t* data, size_t len)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0 ; i < len ; i++) {
+        uint8_t b = data[i];
+        for (uint8_t j = 0 ; j < 8 ; j++) {
+            uint8_t mix = (crc ^ b) & 0x01;
+            crc >>= 1;
+            if (mix) {
+                crc ^= 0x8C;
+            }
+            b >>= 1;
+        }
+    }
+    return crc;
+}
+
+
+static bool LoadSlaves(const char* modulePath)
+{
+    // dlopen() returns the already loaded module for the same file, so every slave gets its own copy of it.
+    FILE* in = fopen(modulePath, "rb");
+    if (!in) {
+        perror(modulePath);
+        return false;
+    }
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+    rewind(in);
+    char* image = malloc((size_t) size);
+    if (!image  ||  fread(image, 1, (size_t) size, in) != (size_t) size) {
+        fprintf(stderr, "%s: read failed\n", modulePath);
+        fclose(in);
+        free(image);
+        return false;
+    }
+    fclose(in);
+
+    char dir[] = "/tmp/owb_bus_sim.XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        free(image);
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0 ; i < NumSlaves  &&  ok ; i++) {
+        Slave* s = &Slaves[i];
+        char path[64];
+        snprintf(path, sizeof(path), "%s/slave%d.so", dir, i);
+
+        FILE* out = fopen(path, "wb");
+        if (!out  ||  fwrite(image, 1, (size_t) size, out) != (size_t) size) {
+            fprintf(stderr, "%s: write failed\n", path);
+            ok = false;
+        }
+        if (out) {
+            fclose(out);
+        }
+
+        if (ok) {
+            s->Module = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+            if (!s->Module) {
+                fprintf(stderr, "%s\n", dlerror());
+                ok = false;
+            }
+        }
+        unlink(path);
+
+        if (ok) {
+            s->ROMCode = (uint8_t*) dlsym(s->Module, "OWBROMCode");
+            *(void**) &s->Init = dlsym(s->Module, "OWBHostInit");
+            *(void**) &s->Slot = dlsym(s->Module, "OWBHostSlot");
+            *(void**) &s->Read0ReleaseTicks = dlsym(s->Module, "OWBHostRead0ReleaseTicks");
+            if (!s->ROMCode  ||  !s->Init  ||  !s->Slot  ||  !s->Read0ReleaseTicks) {
+                fprintf(stderr, "%s: not a host model module\n", modulePath);
+                ok = false;
+            }
+        }
+    }
+
+    rmdir(dir);
+    free(image);
+    return ok;
+}
+
+static void InitSlaves(double skewPercent)
+{
+    for (int i = 0 ; i < NumSlaves ; i++) {
+        Slave* s = &Slaves[i];
+        if (!s->FixedSkew) {
+            s->Skew = RandomUniform(-skewPercent, skewPercent);
+        }
+        s->TicksPerUs = (F_CPU / 1000000.0) * (1.0 + s->Skew/100.0);
+        memcpy(s->ROMCode, ROMCodes[i], 8);
+        s->Init();
+    }
+}
+
+
+// Sends a LOW pulse of the given length and returns whether the bus was LOW at the given sample time (both in
+// microseconds after the falling edge). Result flags of all slaves are ORed into *result.
+static bool BusSlot(double lowUs, double sampleUs, double slotUs, uint8_t* result)
+{
+    double busLowUs = lowUs;
+    for (int i = 0 ; i < NumSlaves ; i++) {
+        Slave* s = &Slaves[i];
+        uint16_t releaseTicks = s->Read0ReleaseTicks();
+        if (releaseTicks != 0  &&  releaseTicks / s->TicksPerUs > busLowUs) {
+            busLowUs = releaseTicks / s->TicksPerUs;
+        }
+    }
+
+    *result = 0;
+    for (int i = 0 ; i < NumSlaves ; i++) {
+        Slave* s = &Slaves[i];
+        double ticks = busLowUs * s->TicksPerUs + 0.5;
+        *result |= s->Slot(ticks < 65535.0 ? (uint16_t) ticks : 65535);
+    }
+
+    Counters.BusTimeUs += (busLowUs > slotUs) ? busLowUs : slotUs;
+    return busLowUs > sampleUs;
+}
+
+static bool Reset(void)
+{
+    uint8_t result;
+    Counters.Resets++;
+    BusSlot(Timing->RstLow, 0, Timing->RstSlot, &result);
+    return (result & OWB_HOST_SLOT_PRESENCE) != 0;
+}
+
+static void WriteBit(uint8_t bit)
+{
+    uint8_t result;
+    Counters.Slots++;
+    BusSlot(bit ? Timing->W1Low : Timing->W0Low, 0, Timing->Slot, &result);
+}
+
+static uint8_t ReadBit(void)
+{
+    uint8_t result;
+    Counters.Slots++;
+    return BusSlot(Timing->RLow, Timing->RSample, Timing->Slot, &result) ? 0 : 1;
+}
+
+static void WriteByte(uint8_t b)
+{
+    for (uint8_t i = 0 ; i < 8 ; i++) {
+        WriteBit((b >> i) & 0x01);
+    }
+}
+
+
+// One pass of the search algorithm of Maxim application note 187. Returns false if no slave answered or the bits read
+// were inconsistent.
+static bool Search(uint8_t rom[8], int* lastDiscrepancy, bool* lastDevice)
+{
+    if (!Reset()) {
+        return false;
+    }
+    WriteByte(OWB_SIM_CMD_SEARCH_ROM);
+
+    int lastZero = -1;
+    for (int i = 0 ; i < 64 ; i++) {
+        uint8_t bit = ReadBit();
+        uint8_t complement = ReadBit();
+        uint8_t dir;
+
+        if (bit  &&  complement) {
+            return false;
+        } else if (bit != complement) {
+            dir = bit;
+        } else {
+            if (i < *lastDiscrepancy) {
+                dir = (rom[i/8] >> (i%8)) & 0x01;
+            } else {
+                dir = (i == *lastDiscrepancy);
+            }
+            if (!dir) {
+                lastZero = i;
+            }
+        }
+
+        if (dir) {
+            rom[i/8] |= (uint8_t) (1 << (i%8));
+        } else {
+            rom[i/8] &= (uint8_t) ~(1 << (i%8));
+        }
+        WriteBit(dir);
+    }
+
+    *lastDiscrepancy = lastZero;
+    *lastDevice = (lastZero < 0);
+    return true;
+}
+
+// Enumerates the bus and returns the number of slaves found correctly, or -1 if the enumeration failed.
+static int Enumerate(bool overdrive, bool verbose)
+{
+    uint8_t rom[8] = { 0 };
+    int lastDiscrepancy = -1;
+    bool lastDevice = false;
+    int found = 0;
+
+    Timing = &StandardTiming;
+    if (overdrive) {
+        if (!Reset()) {
+            if (verbose) fprintf(stderr, "No presence pulse\n");
+            return -1;
+        }
+        WriteByte(OWB_SIM_CMD_OVERDRIVE_SKIP);
+        Timing = &OverdriveTiming;
+    }
+
+    bool* seen = calloc((size_t) NumSlaves, sizeof(bool));
+    while (!lastDevice) {
+        if (!Search(rom, &lastDiscrepancy, &lastDevice)) {
+            if (verbose) fprintf(stderr, "Search failed after %d slave(s)\n", found);
+            found = -1;
+            break;
+        }
+
+        int match = -1;
+        for (int i = 0 ; i < NumSlaves ; i++) {
+            if (memcmp(rom, ROMCodes[i], 8) == 0) {
+                match = i;
+                break;
+            }
+        }
+        if (match < 0  ||  seen[match]  ||  CRC8(rom, 7) != rom[7]) {
+            if (verbose) {
+                fprintf(stderr, "%s ROM code", match < 0 ? "Unknown" : "Duplicate");
+                for (int i = 7 ; i >= 0 ; i--) fprintf(stderr, "%s%02X", i == 7 ? " " : "", rom[i]);
+                fprintf(stderr, "\n");
+            }
+            found = -1;
+            break;
+        }
+        seen[match] = true;
+        found++;
+
+        if (found > NumSlaves) {
+            found = -1;
+            break;
+        }
+    }
+    free(seen);
+
+    if (found >= 0  &&  found < NumSlaves  &&  verbose) {
+        fprintf(stderr, "Missed %d slave(s)\n", NumSlaves - found);
+    }
+    return found;
+}
+
+
+static void Usage(const char* argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "    --module <path>         Host model module (default: %s)\n"
+            "    --slaves <n>            Number of slaves on the bus (default: 32)\n"
+            "    --runs <n>              Number of enumerations, each with new random skews (default: 1)\n"
+            "    --seed <n>              Random seed for ROM codes and skews (default: 1)\n"
+            "    --family <hex>          Family code of the ROM codes (default: 28)\n"
+            "    --skew <percent>        Random clock deviation of each slave within +/- percent (default: 0)\n"
+            "    --slave-skew <i>:<pct>  Fixed clock deviation of slave i in percent\n"
+            "    --overdrive             Enumerate at overdrive speed after OVERDRIVE SKIP ROM\n"
+            "    --w1-low, --w0-low, --r-low, --r-sample <us>\n"
+            "                            Master timing at the selected speed\n"
+            "    --quiet                 Only print the summary\n",
+            argv0, OWB_BUS_SIM_MODULE);
+}
+
+int main(int argc, char** argv)
+{
+    const char* modulePath = OWB_BUS_SIM_MODULE;
+    int runs = 1;
+    unsigned long long seed = 1;
+    uint8_t family = 0x28;
+    double skewPercent = 0.0;
+    bool overdrive = false;
+    bool quiet = false;
+    double w1Low = -1, w0Low = -1, rLow = -1, rSample = -1;
+
+    NumSlaves = 32;
+    for (int i = 1 ; i < argc ; i++) {
+        if (strcmp(argv[i], "--slaves") == 0  &&  i+1 < argc) {
+            NumSlaves = atoi(argv[++i]);
+        }
+    }
+    if (NumSlaves < 1) {
+        Usage(argv[0]);
+        return 2;
+    }
+    Slaves = calloc((size_t) NumSlaves, sizeof(Slave));
+    ROMCodes = calloc((size_t) NumSlaves, sizeof(*ROMCodes));
+
+    for (int i = 1 ; i < argc ; i++) {
+        const char* arg = argv[i];
+        const char* val = (i+1 < argc) ? argv[i+1] : NULL;
+        if (strcmp(arg, "--overdrive") == 0) {
+            overdrive = true;
+            continue;
+        } else if (strcmp(arg, "--quiet") == 0) {
+            quiet = true;
+            continue;
+        } else if (!val) {
+            Usage(argv[0]);
+            return 2;
+        }
+        i++;
+
+        if (strcmp(arg, "--module") == 0) {
+            modulePath = val;
+        } else if (strcmp(arg, "--slaves") == 0) {
+            // Already handled
+        } else if (strcmp(arg, "--runs") == 0) {
+            runs = atoi(val);
+        } else if (strcmp(arg, "--seed") == 0) {
+            seed = strtoull(val, NULL, 0);
+        } else if (strcmp(arg, "--family") == 0) {
+            family = (uint8_t) strtoul(val, NULL, 16);
+        } else if (strcmp(arg, "--skew") == 0) {
+            skewPercent = atof(val);
+        } else if (strcmp(arg, "--slave-skew") == 0) {
+            int idx = atoi(val);
+            const char* pct = strchr(val, ':');
+            if (!pct  ||  idx < 0  ||  idx >= NumSlaves) {
+                Usage(argv[0]);
+                return 2;
+            }
+            Slaves[idx].Skew = atof(pct+1);
+            Slaves[idx].FixedSkew = true;
+        } else if (strcmp(arg, "--w1-low") == 0) {
+            w1Low = atof(val);
+        } else if (strcmp(arg, "--w0-low") == 0) {
+            w0Low = atof(val);
+        } else if (strcmp(arg, "--r-low") == 0) {
+            rLow = atof(val);
+        } else if (strcmp(arg, "--r-sample") == 0) {
+            rSample = atof(val);
+        } else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    MasterTiming* timing = overdrive ? &OverdriveTiming : &StandardTiming;
+    if (w1Low >= 0) timing->W1Low = w1Low;
+    if (w0Low >= 0) timing->W0Low = w0Low;
+    if (rLow >= 0) timing->RLow = rLow;
+    if (rSample >= 0) timing->RSample = rSample;
+
+    RandomState = seed ? seed : 1;
+
+    // Distinct random ROM codes with a valid CRC
+    for (int i = 0 ; i < NumSlaves ; i++) {
+        bool duplicate;
+        do {
+            ROMCodes[i][0] = family;
+            uint64_t serial = Random();
+            for (int j = 1 ; j < 7 ; j++) {
+                ROMCodes[i][j] = (uint8_t) (serial >> (8*j));
+            }
+            ROMCodes[i][7] = CRC8(ROMCodes[i], 7);
+            duplicate = false;
+            for (int j = 0 ; j < i ; j++) {
+                duplicate = duplicate  ||  memcmp(ROMCodes[i], ROMCodes[j], 8) == 0;
+            }
+        } while (duplicate);
+    }
+
+    if (!LoadSlaves(modulePath)) {
+        return 2;
+    }
+
+    if (!quiet) {
+        printf("%d slaves, %s speed, clock skew +/-%.2f%%, F_CPU %lu Hz\n", NumSlaves,
+               overdrive ? "overdrive" : "standard", skewPercent, (unsigned long) F_CPU);
+        printf("%-5s %8s %8s %8s %14s %8s\n", "Run", "Found", "Resets", "Slots", "Bus time [ms]", "Max skew");
+    }
+
+    int succeeded = 0;
+    BusCounters total = { 0, 0, 0.0 };
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int run = 0 ; run < runs ; run++) {
+        InitSlaves(skewPercent);
+        memset(&Counters, 0, sizeof(Counters));
+
+        int found = Enumerate(overdrive, !quiet);
+        if (found == NumSlaves) {
+            succeeded++;
+            total.Slots += Counters.Slots;
+            total.Resets += Counters.Resets;
+            total.BusTimeUs += Counters.BusTimeUs;
+        }
+
+        if (!quiet) {
+            double maxSkew = 0.0;
+            for (int i = 0 ; i < NumSlaves ; i++) {
+                double skew = Slaves[i].Skew < 0 ? -Slaves[i].Skew : Slaves[i].Skew;
+                maxSkew = skew > maxSkew ? skew : maxSkew;
+            }
+            printf("%-5d %8s %8llu %8llu %14.3f %7.2f%%\n", run, found == NumSlaves ? "all" : "FAILED",
+                   (unsigned long long) Counters.Resets, (unsigned long long) Counters.Slots,
+                   Counters.BusTimeUs / 1000.0, maxSkew);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double hostSeconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("Enumerated all %d slaves in %d/%d runs (%.1f%%)", NumSlaves, succeeded, runs,
+           runs > 0 ? 100.0 * succeeded / runs : 0.0);
+    if (succeeded > 0) {
+        printf(", %.0f slots, %.3f ms bus time (%.3f ms per slave) on average",
+               (double) total.Slots / succeeded, total.BusTimeUs / 1000.0 / succeeded,
+               total.BusTimeUs / 1000.0 / succeeded / NumSlaves);
+    }
+    printf(", host time %.2f s\n", hostSeconds);
+
+    return succeeded == runs ? 0 : 1;
+}
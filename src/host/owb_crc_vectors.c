@@ -0,0 +1,106 @@
+/*
+    pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+    Copyright (C) 2024 David "Alemarius Nexus" Lerch
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Checks the per-bit CRC macros of OWB_CRC_ENABLED against known transcripts of real devices. The same macros run in
+// the ISR, whose use of them is covered by the replay streams.
+
+#include "owb.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+typedef struct
+{
+    const char* Name;
+    const char* Data;
+    uint16_t Expected;
+} CRCVector;
+
+static const CRCVector CRC8Vectors[] = {
+    // ROM code from Maxim application note 27, with its CRC byte
+    { "AN27 ROM code", "021CB801000000", 0xA2 },
+    { "AN27 ROM code incl. CRC", "021CB801000000A2", 0x00 },
+
+    // DS18B20 READ SCRATCHPAD right after power-up (85 degrees C, 12 bit)
+    { "DS18B20 scratchpad", "50054B467FFF0C10", 0x1C },
+    { "DS18B20 scratchpad incl. CRC", "50054B467FFF0C101C", 0x00 },
+};
+
+static const CRCVector CRC16Vectors[] = {
+    // Standard check value of CRC-16/ARC, which is the same CRC
+    { "ASCII 123456789", "313233343536373839", 0xBB3D },
+
+    // DS2431 WRITE SCRATCHPAD to address 0x0000. The device sends the complement of the CRC16 over the command, the
+    // address and the data, so the CRC16 over the whole transcript is the constant 0xB001.
+    { "DS2431 WRITE SCRATCHPAD", "0F00000011223344556677", 0xF55C },
+    { "DS2431 WRITE SCRATCHPAD incl. CRC", "0F00000011223344556677A30A", 0xB001 },
+};
+
+
+static int Errors = 0;
+
+
+static size_t ParseHex(const char* str, uint8_t* out, size_t maxLen)
+{
+    size_t len = 0;
+    unsigned int b;
+    while (len < maxLen  &&  sscanf(str, "%2x", &b) == 1) {
+        out[len++] = (uint8_t) b;
+        str += 2;
+    }
+    return len;
+}
+
+static void Check(const char* name, uint16_t expected, uint16_t actual)
+{
+    if (actual != expected) {
+        fprintf(stderr, "%s: expected %04X, got %04X\n", name, expected, actual);
+        Errors++;
+    }
+}
+
+int main(void)
+{
+    uint8_t buf[64];
+
+    for (size_t i = 0 ; i < sizeof(CRC8Vectors)/sizeof(CRC8Vectors[0]) ; i++) {
+        size_t len = ParseHex(CRC8Vectors[i].Data, buf, sizeof(buf));
+        uint8_t crc = 0;
+        for (size_t j = 0 ; j < len*8 ; j++) {
+            OWBCRC8Bit(crc, (buf[j/8] >> (j%8)) & 0x01);
+        }
+        Check(CRC8Vectors[i].Name, CRC8Vectors[i].Expected, crc);
+    }
+
+    for (size_t i = 0 ; i < sizeof(CRC16Vectors)/sizeof(CRC16Vectors[0]) ; i++) {
+        size_t len = ParseHex(CRC16Vectors[i].Data, buf, sizeof(buf));
+        uint16_t crc = 0;
+        for (size_t j = 0 ; j < len*8 ; j++) {
+            OWBCRC16Bit(crc, (buf[j/8] >> (j%8)) & 0x01);
+        }
+        Check(CRC16Vectors[i].Name, CRC16Vectors[i].Expected, crc);
+    }
+
+    if (Errors != 0) {
+        fprintf(stderr, "%d error(s)\n", Errors);
+        return 1;
+    }
+    return 0;
+}
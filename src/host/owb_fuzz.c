@@ -0,0 +1,59 @@
+/*
+    pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+    Copyright (C) 2024 David "Alemarius Nexus" Lerch
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// libFuzzer target for the protocol state machine. Every input byte is interpreted as one LOW pulse of the master,
+// with the length scaled so that all slot types (W1, W0/READ, RESET) are reachable. After each slot, the invariants
+// that the ISR relies on are checked.
+
+#include "owb_host.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+
+
+static void CheckInvariants(void)
+{
+    // The READ0 fast path in the ISR only works if this is either 0 or exactly the IRQ flag, and only while a READ0
+    // is pending.
+    if (OWBLLNextRead0INTRQFlag != 0) {
+        if (OWBLLNextRead0INTRQFlag != OWB_LOW_DETECT_IRQ_FLAG) abort();
+        if (!(OWBLLStateFlags & OWB_STATE_FLAG_NEXT_IS_READ)) abort();
+        if (OWBLLCurrentBitValue != 0) abort();
+    }
+
+    if (OWBLLStateFlags & OWB_STATE_FLAG_MIGHT_BE_RST) abort();
+
+    // Every RST (including a bus fault) must be over and back to waiting for falling edges once the bus is idle
+    if (OWBLLResetPhase != OWB_RESET_PHASE_NONE) abort();
+    if (INTEN != OWB_IDLE_INT_ENABLE) abort();
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    OWBHostInit();
+    OWBHostReset();
+
+    for (size_t i = 0 ; i < size ; i++) {
+        // 0..254 -> 0..~640us at 4MHz, 255 -> bus stuck LOW past the fault timeout
+        OWBHostSlot(data[i] == 0xFF ? 0xFFFF : (uint16_t) (data[i] * (OWB_TIMING_RST_0_MIN / 80 + 1)));
+        CheckInvariants();
+    }
+
+    return 0;
+}
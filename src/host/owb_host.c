@@ -0,0 +1,269 @@
+/*
+    pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+    Copyright (C) 2024 David "Alemarius Nexus" Lerch
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "owb_host.h"
+
+
+// Mock I/O registers (see include/pdk/device.h)
+volatile uint8_t _pa;
+volatile uint8_t _pac;
+volatile uint8_t _padier;
+volatile uint8_t _inten;
+volatile uint8_t _intrq;
+volatile uint8_t _integs;
+volatile uint8_t _t16m;
+volatile uint16_t _t16c;
+volatile uint8_t _gpcc;
+volatile uint8_t _gpcs;
+
+// Set by __stopexe(), until the next slot wakes up the core
+volatile uint8_t OWBHostStopped;
+
+// Defined in main.c on the device
+volatile uint16_t T16Value;
+
+uint8_t OWBROMCode[8] = { 0x28, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x00 };
+
+#ifdef OWB_SCRATCHPAD_ENABLED
+// Defined by the application on the device
+uint8_t OWBScratchpad[OWB_SCRATCHPAD_SIZE];
+#endif
+
+
+// Master timing used by the convenience functions, in microseconds
+#define OWB_HOST_MASTER_W1_LOW      6
+#define OWB_HOST_MASTER_W0_LOW      60
+#define OWB_HOST_MASTER_R_LOW       6
+#define OWB_HOST_MASTER_RST_LOW     480
+
+// The ISR has to pull the bus low for a READ0 before the shortest LOW pulse a master sends ends (see interrupt.c)
+#define OWB_HOST_READ0_BUDGET_US    5
+
+
+void OWBHostInit(void)
+{
+    OWBLLStateFlags = 0;
+    OWBLLNextRead0INTRQFlag = 0;
+    CurrentState = OWB_STATE_IDLE;
+    OWBHostStopped = 0;
+
+    OWBInit();
+}
+
+uint8_t OWBHostSlot(uint16_t lowTicks)
+{
+    uint8_t result = 0;
+
+    // T16 is started at ISR entry, so it lags behind the falling edge by the interrupt latency. If OWBIdle() stopped
+    // the core, the edge first has to wake it up.
+    uint16_t latency = OWB_TIMING_LOW_TO_ISR_LATENCY_TICKS;
+    if (OWBHostStopped) {
+        latency += OWB_IDLE_WAKEUP_TICKS;
+        OWBHostStopped = 0;
+    }
+    uint16_t t16 = lowTicks > latency ? lowTicks-latency : 0;
+
+    INTRQ |= OWB_LOW_DETECT_IRQ_FLAG;
+
+    // The following mirrors interrupt().
+    if (INTRQ & OWBLLNextRead0INTRQFlag) {
+#ifdef OWB_SKIP_SHORT_PULSES
+        if (t16 != 0) {
+#endif
+            // Pulling the bus low past the READ0 budget doesn't reliably reach the master, so it doesn't count
+            if (latency <= OWB_TIMING_US_TO_TICKS(OWB_HOST_READ0_BUDGET_US)) {
+                result |= OWB_HOST_SLOT_PULLED_LOW;
+            }
+
+            if (OWBLLStateFlags & OWB_STATE_FLAG_DELAYED_SWITCH_TO_WRITE) {
+                OWBLLSwitchToWriteImmediately();
+            } else {
+                OWBLLSetupNextRead();
+            }
+
+            OWBLLStateFlags |= OWB_STATE_FLAG_MIGHT_BE_RST;
+
+#if defined(OWB_STATS_ENABLED)  &&  !defined(OWB_SKIP_SHORT_PULSES)  &&  !defined(OWB_SECOND_BUS_ENABLED)
+            // The bus was already HIGH again when the ISR pulled it low
+            if (t16 == 0) {
+                OWBStats.Read0Late++;
+            }
+#endif
+
+            // The slave's own READ0 pulse extends the LOW time
+            if (t16 < OWB_TIMING(R0_0)) {
+                t16 = OWB_TIMING(R0_0);
+            }
+#ifdef OWB_SKIP_SHORT_PULSES
+#ifdef OWB_STATS_ENABLED
+        } else {
+            OWBStats.Read0Late++;
+#endif
+        }
+#endif
+    } else if (OWBLLStateFlags & OWB_STATE_FLAG_NEXT_IS_READ) {
+        if (OWBLLStateFlags & OWB_STATE_FLAG_DELAYED_SWITCH_TO_WRITE) {
+            OWBLLSwitchToWriteImmediately();
+        } else {
+            OWBLLSetupNextRead();
+        }
+
+        OWBLLStateFlags |= OWB_STATE_FLAG_MIGHT_BE_RST;
+    } else {
+#ifdef OWB_STATS_ENABLED
+        // The ISR stops measuring as soon as the pulse is long enough for a WRITE0
+        T16Value = (t16 < OWB_TIMING(W0_0_MIN)) ? t16 : OWB_TIMING(W0_0_MIN);
+        OWBLLStatsWriteDecided();
+#endif
+        if (t16 >= OWB_TIMING(W0_0_MIN)) {
+            OWBLLCurrentBitValue = 0;
+            OWBWriteBit();
+            OWBLLStateFlags |= OWB_STATE_FLAG_MIGHT_BE_RST;
+#ifdef OWB_SKIP_SHORT_PULSES
+        } else if (t16 >= OWB_TIMING(W1_0_MIN)) {
+#else
+        } else {
+#endif
+#ifdef OWB_CALIBRATION_LEARN_MASTER
+            T16Value = t16;
+            OWBLLLearnW1();
+#endif
+            OWBLLCurrentBitValue = 1;
+            OWBWriteBit();
+#if defined(OWB_SKIP_SHORT_PULSES)  &&  defined(OWB_STATS_ENABLED)
+        } else {
+            OWBStats.ShortPulses++;
+#endif
+        }
+    }
+
+#ifdef OWB_STATS_ENABLED
+    if (OWBLLStatsWriteBin) {
+        OWBLLStatsRecordWrite();
+    }
+#endif
+
+    INTRQ &= ~OWB_LOW_DETECT_IRQ_FLAG;
+
+    if (OWBLLStateFlags & OWB_STATE_FLAG_MIGHT_BE_RST) {
+        if (t16 >= OWB_TIMING(RST_0_MIN)) {
+            OWBReset();
+#ifdef OWB_OVERDRIVE_ENABLED
+            if ((OWBLLStateFlags & OWB_STATE_FLAG_OVERDRIVE)  &&  t16 >= OWB_TIMING_STD(RST_0_MIN)) {
+                OWBLLStateFlags &= ~OWB_STATE_FLAG_OVERDRIVE;
+            }
+#endif
+            OWBLLSwitchToWriteImmediately();
+            OWBLLIntOnRising();
+            OWBLLSetT16IntSrc(OWB_T16_FAULT_INT_SRC);
+            INTRQ &= ~INTRQ_T16;
+            INTEN = OWB_LOW_DETECT_INT_ENABLE | INTEN_T16;
+            OWBLLResetPhase = OWB_RESET_PHASE_WAIT_IDLE;
+        }
+    }
+
+    OWBLLStateFlags &= ~OWB_STATE_FLAG_MIGHT_BE_RST;
+
+    if (OWBLLResetPhase != OWB_RESET_PHASE_NONE) {
+        // The remaining RST phases run from their own interrupts: The rising edge at the end of the master's LOW
+        // pulse, and two T16 timeouts. A LOW pulse beyond the fault timeout first raises the T16 interrupt.
+        if (t16 >= (1u << OWB_T16_FAULT_INT_BIT)) {
+            INTRQ |= INTRQ_T16;
+            OWBLLResetStep();
+            result |= OWB_HOST_SLOT_BUS_FAULT;
+        }
+#ifdef OWB_SECOND_BUS_ENABLED
+        if (OWBLLOnBus1()) {
+            OWB_BUS1_Px |= (1 << OWB_BUS1_PIN);
+        } else {
+            OWB_Px |= (1 << OWB_PIN);
+        }
+#else
+        OWB_Px |= (1 << OWB_PIN);
+#endif
+        OWBLLResetStep();
+        while (OWBLLResetPhase != OWB_RESET_PHASE_NONE) {
+            INTRQ |= INTRQ_T16;
+            OWBLLResetStep();
+            if (OWBLLResetPhase == OWB_RESET_PHASE_PRESENCE) {
+                result |= OWB_HOST_SLOT_PRESENCE;
+            }
+        }
+    }
+
+#ifdef OWB_OVERDRIVE_ENABLED
+    if (OWBLLStateFlags & OWB_STATE_FLAG_DELAYED_SWITCH_TO_OVERDRIVE) {
+        OWBLLStateFlags &= ~OWB_STATE_FLAG_DELAYED_SWITCH_TO_OVERDRIVE;
+        OWBLLStateFlags |= OWB_STATE_FLAG_OVERDRIVE;
+    }
+#endif
+
+    return result;
+}
+
+uint16_t OWBHostRead0ReleaseTicks(void)
+{
+    // Same condition as at the start of OWBHostSlot()
+    if (!((INTRQ | OWB_LOW_DETECT_IRQ_FLAG) & OWBLLNextRead0INTRQFlag)) {
+        return 0;
+    }
+    return OWB_TIMING_LOW_TO_ISR_LATENCY_TICKS + OWB_TIMING(R0_0);
+}
+
+#ifdef OWB_SECOND_BUS_ENABLED
+void OWBHostSelectBus(uint8_t bus)
+{
+    // Mirrors the start of interrupt(), which swaps in the state of the other bus if its falling edge caused the
+    // interrupt
+    if ((OWBLLOnBus1() != 0) != (bus != 0)) {
+        OWBLLSwitchBus();
+    }
+}
+#endif
+
+bool OWBHostReset(void)
+{
+    return (OWBHostSlot(OWB_TIMING_US_TO_TICKS(OWB_HOST_MASTER_RST_LOW)) & OWB_HOST_SLOT_PRESENCE) != 0;
+}
+
+void OWBHostWriteBit(uint8_t bit)
+{
+    OWBHostSlot(OWB_TIMING_US_TO_TICKS(bit ? OWB_HOST_MASTER_W1_LOW : OWB_HOST_MASTER_W0_LOW));
+}
+
+uint8_t OWBHostReadBit(void)
+{
+    return (OWBHostSlot(OWB_TIMING_US_TO_TICKS(OWB_HOST_MASTER_R_LOW)) & OWB_HOST_SLOT_PULLED_LOW) ? 0 : 1;
+}
+
+void OWBHostWriteByte(uint8_t b)
+{
+    for (uint8_t i = 0 ; i < 8 ; i++) {
+        OWBHostWriteBit((b >> i) & 0x01);
+    }
+}
+
+uint8_t OWBHostReadByte(void)
+{
+    uint8_t b = 0;
+    for (uint8_t i = 0 ; i < 8 ; i++) {
+        b |= OWBHostReadBit() << i;
+    }
+    return b;
+}
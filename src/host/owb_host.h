@@ -0,0 +1,75 @@
+/*
+    pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+    Copyright (C) 2024 David "Alemarius Nexus" Lerch
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+// Host-side model of the low-level driver (interrupt.c). It mirrors the ISR's decisions for a single LOW pulse of
+// the master, but works on pulse lengths instead of real time, and then calls into the unmodified high-level code in
+// owb.c. This allows driving the protocol state machine on a PC.
+
+#include "owb.h"
+#include "owbll.h"
+
+
+// The ROM code served by the slave (see the mock easy-pdk/serial_num.h)
+extern uint8_t OWBROMCode[8];
+
+// High-level state from owb.c
+extern uint8_t CurrentState;
+extern uint8_t CurrentByte;
+extern uint8_t CurrentBitValue;
+extern uint8_t OWBRESUMEFlag;
+
+
+enum OWBHostSlotResult
+{
+    // The slave pulled the bus low after the master's LOW pulse (READ0)
+    OWB_HOST_SLOT_PULLED_LOW    = 0x01,
+
+    // The slave detected a RESET and sent a presence pulse
+    OWB_HOST_SLOT_PRESENCE      = 0x02,
+
+    // The LOW pulse exceeded the bus fault timeout
+    OWB_HOST_SLOT_BUS_FAULT     = 0x04
+};
+
+
+// Initialize the mock hardware and the driver, like main() does on the device.
+void OWBHostInit(void);
+
+// Process a single LOW pulse of the master with the given length in T16 ticks (i.e. CPU cycles), measured from the
+// falling edge. Returns a combination of OWBHostSlotResult flags.
+uint8_t OWBHostSlot(uint16_t lowTicks);
+
+// Number of ticks after the falling edge at which the slave will release the bus again if it pulls it low in the next
+// slot (i.e. answers a READ with 0), or 0 if it won't. This is decided at ISR entry, before the length of the LOW pulse
+// is known, so it can be asked before OWBHostSlot() to find out how long the wired-AND bus will stay low.
+uint16_t OWBHostRead0ReleaseTicks(void);
+
+#ifdef OWB_SECOND_BUS_ENABLED
+// Make the following slots arrive on the given bus (0 or 1), like a falling edge on that bus would.
+void OWBHostSelectBus(uint8_t bus);
+#endif
+
+// Convenience functions emulating a master with standard 1-Wire timing.
+bool OWBHostReset(void);
+void OWBHostWriteBit(uint8_t bit);
+uint8_t OWBHostReadBit(void);
+void OWBHostWriteByte(uint8_t b);
+uint8_t OWBHostReadByte(void);
@@ -0,0 +1,436 @@
+/*
+    pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+    Copyright (C) 2024 David "Alemarius Nexus" Lerch
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Replays a recorded master bit stream against the high-level protocol code, and optionally benchmarks the number of
+// host instructions spent per 1-Wire slot, grouped by the state the slave was in.
+//
+// Stream format (whitespace separated tokens, '#' starts a comment until the end of the line):
+//
+//      ROM=<16 hex digits>     Set the slave's ROM code, byte 0 (family code) first, and reinitialize it
+//      SPEED=STD, SPEED=OD     Switch the master between standard and overdrive timing
+//      RST                     RESET, expecting a presence pulse
+//      W=<hex bytes>           Write bytes, LSB first
+//      w0, w1                  Write a single bit
+//      R=<hex bytes>           Read bytes and expect the given values
+//      R?<n>                   Read <n> bytes and print them
+//      r                       Read a single bit and print it
+//      r0, r1                  Read a single bit and expect the given value
+//      P=<ticks>               Send a raw LOW pulse of <ticks> T16 ticks and print the slot result
+//      P=<ticks>:<result>      Send a raw LOW pulse and expect the given slot result: 'L' if the slave pulled the bus
+//                              low, 'P' if it sent a presence pulse, both or '-' for neither (bus faults are ignored)
+//      RESUME=0, RESUME=1      Expect that RESUME would (1) or wouldn't (0) select the slave right now
+//
+// With OWB_FIFO_ENABLED, the following tokens act as the slave's main loop:
+//
+//      TX=<hex bytes>          Queue bytes in the TX FIFO
+//      RX=<hex bytes>          Expect the given bytes in the RX FIFO, starting a new function command if the slave was
+//                              selected since the last RX token
+//
+// With OWB_ALARM_SEARCH_ENABLED:
+//
+//      ALARM=0, ALARM=1        Clear or set the slave's alarm flag
+//
+// With OWB_VIRTUAL_SLAVES_ENABLED:
+//
+//      SELECTED=<hex>          Expect the given mask of selected virtual slaves
+//
+// With OWB_CRC_ENABLED:
+//
+//      CRC8=<hex>, CRC16=<hex> Expect the given value of the slave's running CRC
+//
+// With OWB_SECOND_BUS_ENABLED:
+//
+//      BUS=0, BUS=1            Send all following slots on the given bus
+//
+// With OWB_IDLE_ENABLED:
+//
+//      IDLE=0, IDLE=1          Run OWBIdle() like the main loop does, and expect it to leave the core running (0) or
+//                              to stop it (1). A stopped core delays the ISR of the next slot by the wake-up time.
+
+#include "owb_host.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+#define MAX_STATES 32
+
+
+// Master timing in microseconds
+typedef struct
+{
+    uint16_t W1Low;
+    uint16_t W0Low;
+    uint16_t RLow;
+    uint16_t RstLow;
+} MasterTiming;
+
+static const MasterTiming StandardTiming = { 6, 60, 6, 480 };
+static const MasterTiming OverdriveTiming = { 1, 8, 1, 70 };
+
+static const MasterTiming* Timing = &StandardTiming;
+
+static int Verbose = 1;
+static int Errors = 0;
+
+static int PerfFD = -1;
+static uint64_t BenchCount[MAX_STATES];
+static uint64_t BenchTotal[MAX_STATES];
+static uint64_t BenchMax[MAX_STATES];
+
+
+static void PerfOpen(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    PerfFD = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    if (PerfFD < 0) {
+        fprintf(stderr, "Instruction counter not available, measuring nanoseconds instead.\n");
+    }
+}
+
+static uint64_t PerfRead(void)
+{
+#ifdef __linux__
+    if (PerfFD >= 0) {
+        uint64_t count = 0;
+        if (read(PerfFD, &count, sizeof(count)) != sizeof(count)) {
+            return 0;
+        }
+        return count;
+    }
+#endif
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint8_t Slot(uint16_t lowTicks)
+{
+    uint8_t state = CurrentState < MAX_STATES ? CurrentState : MAX_STATES-1;
+
+#ifdef __linux__
+    if (PerfFD >= 0) {
+        ioctl(PerfFD, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    uint64_t start = PerfRead();
+    uint8_t result = OWBHostSlot(lowTicks);
+    uint64_t cost = PerfRead() - start;
+#ifdef __linux__
+    if (PerfFD >= 0) {
+        ioctl(PerfFD, PERF_EVENT_IOC_DISABLE, 0);
+    }
+#endif
+
+    BenchCount[state]++;
+    BenchTotal[state] += cost;
+    if (cost > BenchMax[state]) {
+        BenchMax[state] = cost;
+    }
+
+    return result;
+}
+
+static uint8_t ReadBit(void)
+{
+    return (Slot(OWB_TIMING_US_TO_TICKS(Timing->RLow)) & OWB_HOST_SLOT_PULLED_LOW) ? 0 : 1;
+}
+
+static void WriteBit(uint8_t bit)
+{
+    Slot(OWB_TIMING_US_TO_TICKS(bit ? Timing->W1Low : Timing->W0Low));
+}
+
+static uint8_t ReadByte(void)
+{
+    uint8_t b = 0;
+    for (uint8_t i = 0 ; i < 8 ; i++) {
+        b |= ReadBit() << i;
+    }
+    return b;
+}
+
+static int HexNibble(char c)
+{
+    if (c >= '0'  &&  c <= '9') return c - '0';
+    c = (char) tolower((unsigned char) c);
+    if (c >= 'a'  &&  c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static size_t ParseHex(const char* str, uint8_t* out, size_t maxLen)
+{
+    size_t len = 0;
+    while (str[0]  &&  str[1]  &&  len < maxLen) {
+        int hi = HexNibble(str[0]), lo = HexNibble(str[1]);
+        if (hi < 0  ||  lo < 0) {
+            break;
+        }
+        out[len++] = (uint8_t) ((hi << 4) | lo);
+        str += 2;
+    }
+    return len;
+}
+
+static void ReplayToken(const char* tok, int line)
+{
+    uint8_t buf[256];
+    size_t len;
+
+    if (strncmp(tok, "ROM=", 4) == 0) {
+        if (ParseHex(tok+4, OWBROMCode, 8) != 8) {
+            fprintf(stderr, "line %d: ROM code must have 8 bytes\n", line);
+            Errors++;
+        }
+
+        // OWBInit() might keep a copy of the ROM code
+        OWBHostInit();
+    } else if (strcmp(tok, "SPEED=STD") == 0) {
+        Timing = &StandardTiming;
+    } else if (strcmp(tok, "SPEED=OD") == 0) {
+        Timing = &OverdriveTiming;
+    } else if (strcmp(tok, "RST") == 0) {
+        if (!(Slot(OWB_TIMING_US_TO_TICKS(Timing->RstLow)) & OWB_HOST_SLOT_PRESENCE)) {
+            fprintf(stderr, "line %d: no presence pulse\n", line);
+            Errors++;
+        }
+    } else if (strncmp(tok, "W=", 2) == 0) {
+        len = ParseHex(tok+2, buf, sizeof(buf));
+        for (size_t i = 0 ; i < len ; i++) {
+            for (uint8_t j = 0 ; j < 8 ; j++) {
+                WriteBit((buf[i] >> j) & 0x01);
+            }
+        }
+    } else if (strcmp(tok, "w0") == 0  ||  strcmp(tok, "w1") == 0) {
+        WriteBit(tok[1] == '1');
+    } else if (strncmp(tok, "R=", 2) == 0) {
+        len = ParseHex(tok+2, buf, sizeof(buf));
+        for (size_t i = 0 ; i < len ; i++) {
+            uint8_t b = ReadByte();
+            if (b != buf[i]) {
+                fprintf(stderr, "line %d: read byte %zu: expected %02X, got %02X\n", line, i, buf[i], b);
+                Errors++;
+            }
+        }
+    } else if (strncmp(tok, "R?", 2) == 0) {
+        int n = atoi(tok+2);
+        if (Verbose) printf("line %d: R", line);
+        for (int i = 0 ; i < n ; i++) {
+            uint8_t b = ReadByte();
+            if (Verbose) printf(" %02X", b);
+        }
+        if (Verbose) printf("\n");
+    } else if (strcmp(tok, "r") == 0) {
+        uint8_t bit = ReadBit();
+        if (Verbose) printf("line %d: r %u\n", line, bit);
+    } else if (strcmp(tok, "r0") == 0  ||  strcmp(tok, "r1") == 0) {
+        uint8_t bit = ReadBit();
+        if (bit != (uint8_t) (tok[1] - '0')) {
+            fprintf(stderr, "line %d: expected bit %c, got %u\n", line, tok[1], bit);
+            Errors++;
+        }
+    } else if (strcmp(tok, "RESUME=0") == 0  ||  strcmp(tok, "RESUME=1") == 0) {
+        if (OWBRESUMEFlag != (uint8_t) (tok[7] - '0')) {
+            fprintf(stderr, "line %d: expected RESUME flag %c, got %u\n", line, tok[7], OWBRESUMEFlag);
+            Errors++;
+        }
+    } else if (strncmp(tok, "P=", 2) == 0) {
+        const char* expect = strchr(tok, ':');
+        uint8_t res = Slot((uint16_t) atoi(tok+2));
+        if (expect) {
+            uint8_t expected = (strchr(expect, 'L') ? OWB_HOST_SLOT_PULLED_LOW : 0)
+                    | (strchr(expect, 'P') ? OWB_HOST_SLOT_PRESENCE : 0);
+            uint8_t got = res & (OWB_HOST_SLOT_PULLED_LOW | OWB_HOST_SLOT_PRESENCE);
+            if (got != expected) {
+                fprintf(stderr, "line %d: expected slot result %s, got %s%s%s\n", line, expect+1,
+                        (got & OWB_HOST_SLOT_PULLED_LOW) ? "L" : "", (got & OWB_HOST_SLOT_PRESENCE) ? "P" : "",
+                        got ? "" : "-");
+                Errors++;
+            }
+        } else if (Verbose) {
+            printf("line %d: P%s%s%s\n", line, (res & OWB_HOST_SLOT_PULLED_LOW) ? " pulled-low" : "",
+                    (res & OWB_HOST_SLOT_PRESENCE) ? " presence" : "",
+                    (res & OWB_HOST_SLOT_BUS_FAULT) ? " bus-fault" : "");
+        }
+#ifdef OWB_FIFO_ENABLED
+    } else if (strncmp(tok, "TX=", 3) == 0) {
+        len = ParseHex(tok+3, buf, sizeof(buf));
+        for (size_t i = 0 ; i < len ; i++) {
+            if (!OWBFIFOTxPut(buf[i])) {
+                fprintf(stderr, "line %d: TX FIFO full at byte %zu\n", line, i);
+                Errors++;
+            }
+        }
+    } else if (strncmp(tok, "RX=", 3) == 0) {
+        OWBFIFONewTransaction();
+        len = ParseHex(tok+3, buf, sizeof(buf));
+        for (size_t i = 0 ; i < len ; i++) {
+            if (!OWBFIFORxAvailable()) {
+                fprintf(stderr, "line %d: RX FIFO empty at byte %zu\n", line, i);
+                Errors++;
+                break;
+            }
+            uint8_t b = OWBFIFORxGet();
+            if (b != buf[i]) {
+                fprintf(stderr, "line %d: RX byte %zu: expected %02X, got %02X\n", line, i, buf[i], b);
+                Errors++;
+            }
+        }
+#endif
+#ifdef OWB_ALARM_SEARCH_ENABLED
+    } else if (strcmp(tok, "ALARM=0") == 0) {
+        OWBClearAlarm();
+    } else if (strcmp(tok, "ALARM=1") == 0) {
+        OWBSetAlarm();
+#endif
+#ifdef OWB_VIRTUAL_SLAVES_ENABLED
+    } else if (strncmp(tok, "SELECTED=", 9) == 0) {
+        unsigned long mask = strtoul(tok+9, NULL, 16);
+        if (mask != OWBSelectedSlaves) {
+            fprintf(stderr, "line %d: expected selected virtual slaves %02lX, got %02X\n", line, mask,
+                    OWBSelectedSlaves);
+            Errors++;
+        }
+#endif
+#ifdef OWB_SECOND_BUS_ENABLED
+    } else if (strcmp(tok, "BUS=0") == 0  ||  strcmp(tok, "BUS=1") == 0) {
+        OWBHostSelectBus((uint8_t) (tok[4] - '0'));
+#endif
+#ifdef OWB_IDLE_ENABLED
+    } else if (strcmp(tok, "IDLE=0") == 0  ||  strcmp(tok, "IDLE=1") == 0) {
+        OWBIdle();
+        if (OWBHostStopped != (uint8_t) (tok[5] - '0')) {
+            fprintf(stderr, "line %d: expected the core %s\n", line, OWBHostStopped ? "running" : "stopped");
+            Errors++;
+        }
+#endif
+#ifdef OWB_CRC_ENABLED
+    } else if (strncmp(tok, "CRC8=", 5) == 0) {
+        unsigned long crc = strtoul(tok+5, NULL, 16);
+        if (crc != OWBCRC8) {
+            fprintf(stderr, "line %d: expected CRC8 %02lX, got %02X\n", line, crc, OWBCRC8);
+            Errors++;
+        }
+    } else if (strncmp(tok, "CRC16=", 6) == 0) {
+        unsigned long crc = strtoul(tok+6, NULL, 16);
+        if (crc != OWBCRC16Get()) {
+            fprintf(stderr, "line %d: expected CRC16 %04lX, got %04X\n", line, crc, OWBCRC16Get());
+            Errors++;
+        }
+#endif
+    } else {
+        fprintf(stderr, "line %d: invalid token '%s'\n", line, tok);
+        Errors++;
+    }
+}
+
+static void Replay(FILE* f)
+{
+    char lineBuf[1024];
+    int line = 0;
+
+    while (fgets(lineBuf, sizeof(lineBuf), f)) {
+        line++;
+
+        char* comment = strchr(lineBuf, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        for (char* tok = strtok(lineBuf, " \t\r\n") ; tok ; tok = strtok(NULL, " \t\r\n")) {
+            ReplayToken(tok, line);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int benchIterations = 0;
+    const char* path = NULL;
+
+    for (int i = 1 ; i < argc ; i++) {
+        if (strcmp(argv[i], "--bench") == 0  &&  i+1 < argc) {
+            benchIterations = atoi(argv[++i]);
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "Usage: %s [--bench <iterations>] <stream file>\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "Usage: %s [--bench <iterations>] <stream file>\n", argv[0]);
+        return 2;
+    }
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return 2;
+    }
+
+    if (benchIterations > 0) {
+        PerfOpen();
+        Verbose = 0;
+        for (int i = 0 ; i < benchIterations ; i++) {
+            OWBHostInit();
+            Timing = &StandardTiming;
+            rewind(f);
+            Replay(f);
+        }
+
+        printf("%-6s %10s %10s %10s\n", "State", "Slots", "Avg", "Max");
+        for (int i = 0 ; i < MAX_STATES ; i++) {
+            if (BenchCount[i] != 0) {
+                printf("%-6d %10llu %10llu %10llu\n", i, (unsigned long long) BenchCount[i],
+                       (unsigned long long) (BenchTotal[i] / BenchCount[i]), (unsigned long long) BenchMax[i]);
+            }
+        }
+    } else {
+        OWBHostInit();
+        Replay(f);
+    }
+
+    fclose(f);
+
+    if (Errors != 0) {
+        fprintf(stderr, "%d error(s)\n", Errors);
+        return 1;
+    }
+    return 0;
+}
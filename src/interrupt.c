@@ -25,10 +25,61 @@
 #if F_CPU < 4000000
 #warning 1-Wire slave code might not work at CPU frequencies lower than 4MHz!
 #endif
+#if defined(OWB_OVERDRIVE_ENABLED)  &&  F_CPU < 8000000
+#warning 1-Wire overdrive speed might not work at CPU frequencies lower than 8MHz!
+#endif
+
+#ifdef OWB_SECOND_BUS_ENABLED
+#if defined(OWB_INT_USE_COMP)  ||  defined(OWB_POLLING_MODE)
+#error OWB_SECOND_BUS_ENABLED needs both the pin interrupt and the comparator, one for each bus
+#endif
+#ifdef OWB_FIFO_ENABLED
+#error OWB_SECOND_BUS_ENABLED has no FIFOs per bus
+#endif
+#ifdef OWB_SKIP_SHORT_PULSES
+#error OWB_SKIP_SHORT_PULSES only checks the pin of bus 0
+#endif
+#ifdef OWB_CALIBRATION_ENABLED
+#error OWB_CALIBRATION_ENABLED only measures the latency of bus 0
+#endif
+#if F_CPU < 8000000
+#warning A READ0 on the second 1-Wire bus might be answered too late at CPU frequencies lower than 8MHz!
+#endif
+#endif
+
+
+#ifdef OWB_POLLING_MODE
+#ifdef OWB_FIFO_ENABLED
+#error OWB_POLLING_MODE leaves no main loop to consume the FIFOs of OWB_FIFO_ENABLED
+#endif
+#ifdef OWB_IDLE_ENABLED
+#error OWB_POLLING_MODE never leaves the core idle for OWB_IDLE_ENABLED
+#endif
 
+// In polling mode, the code below is not an ISR, but the body of an endless loop that main() jumps into. It busy-waits
+// for the same IRQ flags that would otherwise trigger the interrupt, so there's no interrupt entry latency, and no
+// registers have to be saved.
+void OWBPollingLoop(void)
+{
+    while (1) {
+        if (OWBLLResetPhase == OWB_RESET_PHASE_NONE) {
+            // Fast path: Only wait for the OWB pin's falling edge. This loop is just two instructions, so the latency
+            // from the edge is at most 3 cycles.
+            __asm
+                2$:
+                t1sn.io __intrq, #(OWB_LOW_DETECT_IRQ_BIT)
+                goto 2$
+            __endasm;
+        } else {
+            // Phases of a RST wait for the interrupts they enabled (see OWBLLResetStep())
+            while (!(INTRQ & INTEN));
+        }
+        OWBMark(PollEntry);
 
+#else
 void interrupt(void) __interrupt(0) __naked // Naked for micro-optimization
 {
+#endif
     // There is a very time-critical section at the start of this ISR, specifically for the READ0 operation. For all
     // other 1-Wire operations, we have a relatively generous time buffer, because we have an entire 1-Wire time slot
     // to recognize and handle them.
@@ -46,21 +97,48 @@ void interrupt(void) __interrupt(0) __naked // Naked for micro-optimization
     // might not be continuous with the master's own LOW pulse (i.e. the bus might go HIGH for a bit in-between). This
     // isn't actually a problem if the master only samples the signal once, with enough delay after the pulse, but it's
     // not how 1-Wire is supposed to look. For such masters, it might also be necessary to disable
-    // OWB_SKIP_SHORT_PULSES.
+    // OWB_SKIP_SHORT_PULSES, or to enable OWB_POLLING_MODE.
 
     // NOTE: This code reports a spurious WRITE0 or READ if the operation is actually a RESET. This is because we have
     // to recognize WRITE0 and especially READ _before_ the end of their LOW pulse, in which case the LOW pulse could
     // still become a RESET. This should hopefully not be a problem, since the RESET would reset any corrupted state
     // caused by these spurious recognitions.
 
+#ifndef OWB_POLLING_MODE
     // Prolog. We delay saving the compiler's p register until after the time-critical block to save 2 cycles. This is
     // valid as long as we don't use the p register (e.g. by writing to T16C).
     __asm__(
             "push af\n"
             );
+#endif
 
     // Enable timer. T16C should already be at 0 right now.
     T16M |= T16M_CLK_SYSCLK;
+    OWBMark(TimerStart);
+    OWBExportValue(LatencyBaseTicks, OWB_TIMING_LOW_TO_ISR_LATENCY_BASE_TICKS);
+#ifdef OWB_INT_USE_COMP
+    OWBExportValue(BusFallTimeNs, OWB_BUS_FALL_TIME_NS);
+    OWBExportValue(CompThresholdPermille, OWB_COMP_THRESHOLD_PERMILLE);
+#endif
+    DbgEvent(OWB_DBG_EVENT_ISR_ENTRY);
+
+#ifdef OWB_SECOND_BUS_ENABLED
+    // Outside of a RST, only the falling edges of both buses are enabled. If it's not the current bus, it's the other
+    // one, so swap in its state first. This delays the READ0 below, but only for the first slot after each swap.
+    if (!(INTRQ & OWB_LOW_DETECT_IRQ_FLAG)  &&  OWBLLResetPhase == OWB_RESET_PHASE_NONE) {
+        OWBMark(BusSwitch);
+        // OWBLLSwitchBus() is free to use the p register, which isn't saved yet
+        __asm__(
+                "mov a, p\n"
+                "push af\n"
+                );
+        OWBLLSwitchBus();
+        __asm__(
+                "pop af\n"
+                "mov p, a\n"
+                );
+    }
+#endif
 
     // This is an optimized version of:
     //
@@ -85,14 +163,23 @@ void interrupt(void) __interrupt(0) __naked // Naked for micro-optimization
         __endasm;
 #endif
 
+#if defined(OWB_STATS_ENABLED)  &&  !defined(OWB_SKIP_SHORT_PULSES)  &&  !defined(OWB_SECOND_BUS_ENABLED)
+        // Count it if the master's LOW pulse is already over. This costs 2 cycles either way.
+        __asm
+            t0sn.io __pa, #(OWB_PIN)
+            inc _OWBStats+OWB_STATS_READ0_LATE_OFFSET
+        __endasm;
+#endif
+
         // Extend the master's LOW pulse for R0
         OWBLLSetLow();
+        OWBMark(Read0Low);
         DbgPulse();
 
         // ***** End of time-critical block for READ0 *****
 
         // Wait for end of R0 pulse
-        OWBLLWaitForT16(OWB_TIMING_R0_0);
+        OWBLLWaitForT16(OWB_TIMING(R0_0));
         OWBLLSetInput();
 
         if (OWBLLStateFlags & OWB_STATE_FLAG_DELAYED_SWITCH_TO_WRITE) {
@@ -104,9 +191,18 @@ void interrupt(void) __interrupt(0) __naked // Naked for micro-optimization
         OWBLLStateFlags |= OWB_STATE_FLAG_MIGHT_BE_RST;
 
 #ifdef OWB_SKIP_SHORT_PULSES
+#ifdef OWB_STATS_ENABLED
+        __asm__(
+                "goto 3$\n"
+                "1$:\n"
+                );
+        OWBStats.Read0Late++;
+        __asm__("3$:\n");
+#else
         __asm__("1$:\n");
 #endif
-    } else if (INTRQ & OWB_LOW_DETECT_IRQ_FLAG) {
+#endif
+    } else if ((INTRQ & OWB_LOW_DETECT_IRQ_FLAG)  &&  OWBLLResetPhase == OWB_RESET_PHASE_NONE) {
         // Not a R0, but might still be R1, W1, W0 or RST
 
         if (OWBLLStateFlags & OWB_STATE_FLAG_NEXT_IS_READ) {
@@ -126,26 +222,37 @@ void interrupt(void) __interrupt(0) __naked // Naked for micro-optimization
 
             do {
                 OWBLLGetT16Value();
-            } while (!OWBLLGetValue()  &&  T16Value < OWB_TIMING_W0_0_MIN);
+            } while (!OWBLLGetValue()  &&  T16Value < OWB_TIMING(W0_0_MIN));
+#ifdef OWB_STATS_ENABLED
+            OWBLLStatsWriteDecided();
+#endif
 
-            if (T16Value >= OWB_TIMING_W0_0_MIN) {
+            if (T16Value >= OWB_TIMING(W0_0_MIN)) {
                 // This is either W0 or RST. We have to assume W0 for now
+                DbgEvent(OWB_DBG_EVENT_WRITE0);
 
                 // Report W0
                 OWBLLCurrentBitValue = 0;
                 OWBWriteBit();
                 OWBLLStateFlags |= OWB_STATE_FLAG_MIGHT_BE_RST;
 #ifdef OWB_SKIP_SHORT_PULSES
-            } else if (T16Value >= OWB_TIMING_W1_0_MIN) {
+            } else if (T16Value >= OWB_TIMING(W1_0_MIN)) {
 #else
             } else {
 #endif
                 // W1 detected (short LOW pulse)
+                DbgEvent(OWB_DBG_EVENT_WRITE1);
+#ifdef OWB_CALIBRATION_LEARN_MASTER
+                OWBLLLearnW1();
+#endif
                 OWBLLCurrentBitValue = 1;
                 OWBWriteBit();
 #ifdef OWB_SKIP_SHORT_PULSES
             } else {
                 // LOW pulse too short even for W1 -> consider it a glitch and ignore it
+#ifdef OWB_STATS_ENABLED
+                OWBStats.ShortPulses++;
+#endif
             }
 #else
             }
@@ -153,14 +260,22 @@ void interrupt(void) __interrupt(0) __naked // Naked for micro-optimization
         }
     }
 
+#ifndef OWB_POLLING_MODE
     // This is usually part of the prolog generated by SDCC. We delay it until now since we didn't use the p register
     // until now, and we want to squeeze out every cycle in the time-critical section above.
     __asm__(
             "mov a, p\n"
             "push af\n"
             );
+#endif
 
-    if (INTRQ & OWB_LOW_DETECT_IRQ_FLAG) {
+#ifdef OWB_STATS_ENABLED
+    if (OWBLLStatsWriteBin) {
+        OWBLLStatsRecordWrite();
+    }
+#endif
+
+    if (OWBLLResetPhase == OWB_RESET_PHASE_NONE  &&  (INTRQ & OWB_LOW_DETECT_IRQ_FLAG)) {
         // Clear IRQ flag only now. We delayed it until now to squeeze out more cycles at the beginning.
         INTRQ &= ~OWB_LOW_DETECT_IRQ_FLAG;
 
@@ -168,40 +283,70 @@ void interrupt(void) __interrupt(0) __naked // Naked for micro-optimization
             // Wait until end of LOW or RST time reached
             do {
                 OWBLLGetT16Value();
-            } while (!OWBLLGetValue()  &&  T16Value < OWB_TIMING_RST_0_MIN);
+            } while (!OWBLLGetValue()  &&  T16Value < OWB_TIMING(RST_0_MIN));
 
-            if (T16Value >= OWB_TIMING_RST_0_MIN  ||  (OWBLLStateFlags & OWB_STATE_FLAG_TIMER_OVERFLOW)) {
+            if (T16Value >= OWB_TIMING(RST_0_MIN)) {
                 // RST detected (very long LOW pulse)
+                DbgEvent(OWB_DBG_EVENT_RESET);
                 OWBReset();
 
-                // Wait until the end of the RST LOW pulse
-                while (!OWBLLGetValue());
-
-                // Leave bus idle for a while before the presence pulse
-                T16C = 0;
-                OWBLLWaitForT16(OWB_TIMING_RST_1);
-
-                // Send presence pulse
-                T16C = 0;
-                OWBLLSetLow();
+#ifdef OWB_OVERDRIVE_ENABLED
+                if (OWBLLStateFlags & OWB_STATE_FLAG_OVERDRIVE) {
+                    // This might only be an overdrive RST. A RST of standard length returns us to standard speed.
+                    do {
+                        OWBLLGetT16Value();
+                    } while (!OWBLLGetValue()  &&  T16Value < OWB_TIMING_STD(RST_0_MIN));
+
+                    if (T16Value >= OWB_TIMING_STD(RST_0_MIN)) {
+                        OWBLLStateFlags &= ~OWB_STATE_FLAG_OVERDRIVE;
+                    }
+                }
+#endif
 
                 OWBLLSwitchToWriteImmediately();
 
-                // Wait for end of presence pulse
-                OWBLLWaitForT16(OWB_TIMING_RST_PP);
-                OWBLLSetInput();
-
-                // Reset IRQ signal again. Our own presence pulse will have falsely set it.
-                INTRQ &= ~OWB_LOW_DETECT_IRQ_FLAG;
+                // The rest of the RST (end of the LOW pulse, idle time and presence pulse) can take several hundred
+                // microseconds, so we don't wait for it here. Instead, each phase ends with an interrupt (see below).
+                // This also bounds the time spent in the ISR if the bus is stuck LOW.
+                OWBLLIntOnRising();
+                OWBLLSetT16IntSrc(OWB_T16_FAULT_INT_SRC);
+                INTRQ &= ~INTRQ_T16;
+                INTEN = OWB_LOW_DETECT_INT_ENABLE | INTEN_T16;
+                OWBLLResetPhase = OWB_RESET_PHASE_WAIT_IDLE;
             }
         }
 
-        // OWB operation complete (excluding final idle time) -> disable and reset timer
-        T16M &= (uint8_t) ~T16M_CLK_SYSCLK;
-        T16C = 0;
+        if (OWBLLResetPhase == OWB_RESET_PHASE_NONE) {
+            // OWB operation complete (excluding final idle time) -> disable and reset timer
+            T16M &= (uint8_t) ~T16M_CLK_SYSCLK;
+            T16C = 0;
+        }
         OWBLLStateFlags &= ~OWB_STATE_FLAG_MIGHT_BE_RST;
+
+#ifdef OWB_OVERDRIVE_ENABLED
+        if (OWBLLStateFlags & OWB_STATE_FLAG_DELAYED_SWITCH_TO_OVERDRIVE) {
+            OWBLLStateFlags &= ~OWB_STATE_FLAG_DELAYED_SWITCH_TO_OVERDRIVE;
+            OWBLLStateFlags |= OWB_STATE_FLAG_OVERDRIVE;
+        }
+#endif
+    }
+
+    if (OWBLLResetPhase != OWB_RESET_PHASE_NONE) {
+        // RST in progress. The bus might already be idle again, so this also runs right after detecting the RST.
+        OWBLLResetStep();
     }
 
+#ifdef OWB_DEBUG_TRACE
+    if (CurrentState != OWBLLDbgState) {
+        OWBLLDbgState = CurrentState;
+        DbgEvent(OWB_DBG_EVENT_STATE);
+    }
+#endif
+
+    OWBMark(ISRExit);
+#ifdef OWB_POLLING_MODE
+    }
+#else
     // Epilog
     __asm__(
             "pop af\n"
@@ -209,4 +354,5 @@ void interrupt(void) __interrupt(0) __naked // Naked for micro-optimization
             "pop af\n"
             "reti\n"
             );
+#endif
 }
@@ -30,6 +30,46 @@ volatile uint16_t T16Value;
 #include "interrupt.c"
 
 
+#ifdef OWB_SCRATCHPAD_ENABLED
+uint8_t OWBScratchpad[OWB_SCRATCHPAD_SIZE];
+#endif
+
+#if defined(OWB_SCRATCHPAD_ENABLED)  &&  !defined(OWB_POLLING_MODE)
+// Where COPY SCRATCHPAD copies the scratchpad to. A real application would write it to its configuration instead.
+static uint8_t ScratchpadCopy[OWB_SCRATCHPAD_SIZE];
+
+// Handle COPY SCRATCHPAD. This runs in the main loop, so the master might already write the scratchpad again while
+// it's being copied. There is no main loop with OWB_POLLING_MODE.
+static void CopyScratchpad(void)
+{
+    for (uint8_t i = 0 ; i < OWB_SCRATCHPAD_SIZE ; i++) {
+        ScratchpadCopy[i] = OWBScratchpad[i];
+    }
+}
+#endif
+
+
+#ifdef OWB_FIFO_ENABLED
+// Example function command, which sends back each following byte. The master writes a byte, waits a bit for the main
+// loop, and then reads the byte back.
+#define FUNCTION_CMD_ECHO   0xEE
+
+// Set while the current function command is FUNCTION_CMD_ECHO
+static bool Echo = false;
+
+// Handle a byte of a function command. This runs in the main loop, so it may take its time, as long as the response
+// (if any) is queued with OWBFIFOTxPut() before the master starts reading it. first is true for the function command
+// byte itself, and false for any following parameter bytes.
+static void HandleFunctionByte(uint8_t b, bool first)
+{
+    if (first) {
+        Echo = (b == FUNCTION_CMD_ECHO);
+    } else if (Echo) {
+        OWBFIFOTxPut(b);
+    }
+}
+#endif
+
 
 int main(void)
 {
@@ -39,14 +79,48 @@ int main(void)
     // even set0/set1 (yes, they do seem to do a read-modify-write operation on the entire register). We'll have to
     // setup the entire register in one go here.
     PADIER = (1u << OWB_PIN)
+#ifdef OWB_SECOND_BUS_ENABLED
+            | (1u << OWB_BUS1_PIN)
+#endif
 #ifdef OWB_DEBUG_ENABLED
             | (1u << DBG_PIN)
 #endif
             ;
 
+#ifdef OWB_CALIBRATION_ENABLED
+    OWBCalibrate();
+#endif
+
+#ifdef OWB_POLLING_MODE
+    // Never returns
+    OWBPollingLoop();
+#else
     __engint();
+#endif
 
-    while (1);
+#ifdef OWB_FIFO_ENABLED
+    bool first = false;
+#endif
+    while (1) {
+#ifdef OWB_FIFO_ENABLED
+        if (OWBFIFONewTransaction()) {
+            first = true;
+        }
+        if (OWBFIFORxAvailable()) {
+            HandleFunctionByte(OWBFIFORxGet(), first);
+            first = false;
+        }
+#endif
+#if defined(OWB_SCRATCHPAD_ENABLED)  &&  !defined(OWB_POLLING_MODE)
+        if (OWBScratchpadCopyRequest) {
+            OWBScratchpadCopyRequest = 0;
+            CopyScratchpad();
+        }
+#endif
+#ifdef OWB_IDLE_ENABLED
+        OWBIdle();
+#endif
+    }
 }
 
 unsigned char __sdcc_external_startup(void)
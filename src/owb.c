@@ -21,17 +21,70 @@
 
 #include <easy-pdk/serial_num.h>
 
+#include <stddef.h>
 #include <stdlib.h>
 
 
+#ifdef OWB_VIRTUAL_SLAVES_ENABLED
+// Bit n of all virtual slaves' ROM codes, bit i belonging to slave i (see owb_write_virtual_rom_codes() in
+// cmake/OWBROMCode.cmake)
+static const uint8_t OWBROMCodeBits[64] = { OWB_VIRTUAL_ROM_CODE_BITS };
+
+#define OWB_VIRTUAL_SLAVES_ALL  ((uint8_t) ((1u << OWB_VIRTUAL_SLAVE_COUNT) - 1))
+#else
 EASY_PDK_SERIAL_NUM(OWBROMCode);
 
+#ifdef OWB_ROM_CODE_IN_RAM
+// Copy of OWBROMCode, filled by OWBInit()
+uint8_t OWBROMCodeRAM[8];
+#define OWBROMCodeByte(idx)     OWBROMCodeRAM[idx]
+#else
+#define OWBROMCodeByte(idx)     OWBROMCode[idx]
+#endif
+#endif
+
 
 volatile uint8_t OWBLLStateFlags = 0;
 
 volatile uint8_t OWBLLNextRead0INTRQFlag = 0;
 volatile uint8_t OWBLLCurrentBitValue;
 
+volatile uint8_t OWBLLResetPhase = OWB_RESET_PHASE_NONE;
+
+#ifdef OWB_CALIBRATION_ENABLED
+struct OWBLLTimingTable OWBLLTimingStd;
+#ifdef OWB_OVERDRIVE_ENABLED
+struct OWBLLTimingTable OWBLLTimingOD;
+#endif
+uint8_t OWBLLLatencyTicks = OWB_TIMING_LOW_TO_ISR_LATENCY_TICKS;
+#endif
+
+#ifdef OWB_COMP_CHARACTERIZATION_ENABLED
+uint8_t OWBCompLatency[OWB_COMP_LEVELS];
+
+_Static_assert(OWB_COMP_LATENCY_COMMAND != 0x4E  &&  OWB_COMP_LATENCY_COMMAND != 0xBE
+               &&  OWB_COMP_LATENCY_COMMAND != 0x48,
+               "OWB_COMP_LATENCY_COMMAND collides with a scratchpad command");
+#ifdef OWB_STATS_ENABLED
+_Static_assert(OWB_COMP_LATENCY_COMMAND != OWB_STATS_COMMAND,
+               "OWB_COMP_LATENCY_COMMAND collides with OWB_STATS_COMMAND");
+#endif
+#endif
+
+#if defined(OWB_INT_USE_COMP)  ||  defined(OWB_SECOND_BUS_ENABLED)
+_Static_assert(OWB_COMP_LEVEL < 16  &&  OWB_COMP_THRESHOLD_PERMILLE < 1000, "Invalid comparator reference");
+#endif
+
+#ifdef OWB_IDLE_ENABLED
+#ifdef OWB_CALIBRATION_ENABLED
+// Wake-up time from stopexe as measured by OWBCalibrate()
+uint8_t OWBLLIdleWakeupTicks = OWB_IDLE_WAKEUP_TICKS;
+#else
+_Static_assert(OWB_IDLE_WAKEUP_TICKS <= OWB_IDLE_WAKEUP_BUDGET_TICKS,
+               "Waking up from stopexe takes too long to recognize a RST");
+#endif
+#endif
+
 
 
 
@@ -41,32 +94,525 @@ volatile uint8_t OWBLLCurrentBitValue;
 // *                                                        *
 // **********************************************************
 
-// ********** READ ROM **********
-uint8_t OWBREADROMByteOffset = 0;
+// ********** READ ROM / SEARCH ROM / MATCH ROM **********
+uint8_t OWBROMCodeByteIndex = 0;
+
+#ifdef OWB_VIRTUAL_SLAVES_ENABLED
+// Virtual slaves still taking part in the current ROM command
+uint8_t OWBROMParticipants;
+
+volatile uint8_t OWBSelectedSlaves = 0;
+
+// The ROM commands work on single bits of all ROM codes at once, so count bits instead of bytes
+#define OWBROMCodeBitIndex  OWBROMCodeByteIndex
+
+// Nothing to prepare, the bits are looked up as they are needed
+#define OWBROMCodeStart()
+#else
+// Prepare sending or comparing the first ROM code byte
+#define OWBROMCodeStart()                                   \
+        do {                                                \
+            CurrentByte = OWBROMCodeByte(0);                \
+            CurrentBitValue++; /* CurrentBitValue = 1 */    \
+        } while (false)
+#endif
+
+// ********** RESUME **********
+// Set while the slave was the last one selected by MATCH ROM or SEARCH ROM, i.e. while RESUME is allowed to select it.
+// With OWB_VIRTUAL_SLAVES_ENABLED, this is the mask of virtual slaves that RESUME selects.
+uint8_t OWBRESUMEFlag = 0;
+
+#ifdef OWB_ALARM_SEARCH_ENABLED
+// ********** ALARM SEARCH **********
+volatile uint8_t OWBAlarmFlag = 0;
+#endif
 
-// ********** SEARCH ROM **********
-uint8_t OWBSEARCHROMCurrentByteIndex = 0;
+
+// ********** ROM command dispatch **********
+
+// Dense IDs of the ROM commands, so that dispatching them compiles to a jump table
+enum OWBROMCommand
+{
+    OWB_ROM_CMD_INVALID,
+    OWB_ROM_CMD_READ_ROM,
+    OWB_ROM_CMD_SEARCH_ROM,
+    OWB_ROM_CMD_MATCH_ROM,
+    OWB_ROM_CMD_SKIP_ROM,
+    OWB_ROM_CMD_RESUME,
+    OWB_ROM_CMD_OVERDRIVE_SKIP_ROM,
+    OWB_ROM_CMD_OVERDRIVE_MATCH_ROM,
+    OWB_ROM_CMD_ALARM_SEARCH
+};
+
+// List of all enabled ROM commands as X(commandByte, commandID)
+#ifdef OWB_READ_ROM_DISABLED
+#define OWB_ROM_COMMANDS_READ_ROM(X)
+#else
+#define OWB_ROM_COMMANDS_READ_ROM(X)                        \
+        X(0x33, OWB_ROM_CMD_READ_ROM)
+#endif
+#ifdef OWB_SEARCH_ROM_DISABLED
+#ifdef OWB_ALARM_SEARCH_ENABLED
+#error OWB_ALARM_SEARCH_ENABLED needs SEARCH ROM
+#endif
+#define OWB_ROM_COMMANDS_SEARCH_ROM(X)
+#else
+#define OWB_ROM_COMMANDS_SEARCH_ROM(X)                      \
+        X(0xF0, OWB_ROM_CMD_SEARCH_ROM)
+#endif
+#ifdef OWB_RESUME_DISABLED
+#define OWB_ROM_COMMANDS_RESUME(X)
+#else
+#define OWB_ROM_COMMANDS_RESUME(X)                          \
+        X(0xA5, OWB_ROM_CMD_RESUME)
+#endif
+#ifdef OWB_OVERDRIVE_ENABLED
+#define OWB_ROM_COMMANDS_OVERDRIVE(X)                       \
+        X(0x3C, OWB_ROM_CMD_OVERDRIVE_SKIP_ROM)             \
+        X(0x69, OWB_ROM_CMD_OVERDRIVE_MATCH_ROM)
+#else
+#define OWB_ROM_COMMANDS_OVERDRIVE(X)
+#endif
+#ifdef OWB_ALARM_SEARCH_ENABLED
+#define OWB_ROM_COMMANDS_ALARM_SEARCH(X)                    \
+        X(0xEC, OWB_ROM_CMD_ALARM_SEARCH)
+#else
+#define OWB_ROM_COMMANDS_ALARM_SEARCH(X)
+#endif
+#define OWB_ROM_COMMANDS(X)                                 \
+        OWB_ROM_COMMANDS_READ_ROM(X)                        \
+        OWB_ROM_COMMANDS_SEARCH_ROM(X)                      \
+        X(0x55, OWB_ROM_CMD_MATCH_ROM)                      \
+        X(0xCC, OWB_ROM_CMD_SKIP_ROM)                       \
+        OWB_ROM_COMMANDS_RESUME(X)                          \
+        OWB_ROM_COMMANDS_OVERDRIVE(X)                       \
+        OWB_ROM_COMMANDS_ALARM_SEARCH(X)
+
+// Perfect hash of the ROM command bytes into the 16 entries of the dispatch tables. Looking up the received byte costs
+// the same no matter how many commands are enabled, unlike comparing it against each command in turn. If a new command
+// collides with an existing one, the static assertion below fails and the hash has to be changed.
+#define OWB_ROM_COMMAND_HASH(cmd)   ((((cmd) ^ ((cmd) >> 4)) >> 3) & 0x0F)
+
+#define OWB_ROM_COMMAND_CODE_ENTRY(cmd, id)     [OWB_ROM_COMMAND_HASH(cmd)] = (cmd),
+#define OWB_ROM_COMMAND_ID_ENTRY(cmd, id)       [OWB_ROM_COMMAND_HASH(cmd)] = (id),
+#define OWB_ROM_COMMAND_HASH_OR(cmd, id)        | (1u << OWB_ROM_COMMAND_HASH(cmd))
+#define OWB_ROM_COMMAND_HASH_SUM(cmd, id)       + (1u << OWB_ROM_COMMAND_HASH(cmd))
+
+// Unused entries are 0, which maps command byte 0x00 (if it hashes to an unused entry) to OWB_ROM_CMD_INVALID.
+static const uint8_t OWBROMCommandCodes[16] = { OWB_ROM_COMMANDS(OWB_ROM_COMMAND_CODE_ENTRY) };
+static const uint8_t OWBROMCommandIDs[16] = { OWB_ROM_COMMANDS(OWB_ROM_COMMAND_ID_ENTRY) };
+
+_Static_assert((0 OWB_ROM_COMMANDS(OWB_ROM_COMMAND_HASH_OR)) == (0 OWB_ROM_COMMANDS(OWB_ROM_COMMAND_HASH_SUM)),
+               "OWB_ROM_COMMAND_HASH() collision between ROM commands");
 
 
 uint8_t CurrentState = OWB_STATE_IDLE;
 uint8_t CurrentByte = 0;
 uint8_t CurrentBitValue = 1;
 
+#ifdef OWB_DEBUG_TRACE
+uint8_t OWBLLDbgState = OWB_STATE_IDLE;
+#endif
+
+#ifdef OWB_CRC_ENABLED
+volatile uint8_t OWBCRC8 = 0;
+volatile uint16_t OWBCRC16 = 0;
+
+// Feed the bit that was just written or read into both CRCs
+#define OWBCRCUpdate()                                          \
+        do {                                                    \
+            OWBCRC8Bit(OWBCRC8, OWBLLCurrentBitValue);          \
+            OWBCRC16Bit(OWBCRC16, OWBLLCurrentBitValue);        \
+        } while (false)
+#endif
+
+
+#ifdef OWB_FIFO_ENABLED
+// ********** Function command FIFOs **********
+volatile uint8_t OWBFIFORx[OWB_FIFO_SIZE];
+volatile uint8_t OWBFIFORxHead = 0;
+volatile uint8_t OWBFIFORxTail = 0;
+
+volatile uint8_t OWBFIFOTx[OWB_FIFO_SIZE];
+volatile uint8_t OWBFIFOTxHead = 0;
+volatile uint8_t OWBFIFOTxTail = 0;
+
+// Incremented by the ISR whenever the slave is selected. OWBFIFORxStart is the value of OWBFIFORxHead at that time.
+volatile uint8_t OWBFIFOTransaction = 0;
+volatile uint8_t OWBFIFORxStart = 0;
+
+// Value of OWBFIFOTransaction last seen by OWBFIFONewTransaction()
+uint8_t OWBFIFOLastTransaction = 0;
+
+#define OWB_FIFO_MASK   (OWB_FIFO_SIZE-1)
+
+// Pass a received byte to the main loop. If it doesn't keep up, the byte is lost.
+#define OWBFIFORxPush(b)                                                        \
+        do {                                                                    \
+            if ((uint8_t) (OWBFIFORxHead - OWBFIFORxTail) != OWB_FIFO_SIZE) {   \
+                OWBFIFORx[OWBFIFORxHead & OWB_FIFO_MASK] = (b);                 \
+                OWBFIFORxHead++;                                                \
+            }                                                                   \
+        } while (false)
+#endif
+
+
+#ifdef OWB_SCRATCHPAD_ENABLED
+// ********** Scratchpad **********
+volatile uint8_t OWBScratchpadCopyRequest = 0;
+#endif
+
+
+#ifdef OWB_STATS_ENABLED
+// ********** Statistics **********
+volatile struct OWBStats OWBStats;
+
+uint8_t OWBLLStatsWriteBin = 0;
+
+_Static_assert(offsetof(struct OWBStats, Read0Late) == OWB_STATS_READ0_LATE_OFFSET
+               &&  offsetof(struct OWBStats, WriteHistogram) + OWB_STATS_HISTOGRAM_BINS == OWB_STATS_SIZE,
+               "Unexpected layout of struct OWBStats");
+_Static_assert(OWB_TIMING_US_TO_TICKS(32) <= 256, "WRITE decisions don't fit into the low byte of T16Value");
+_Static_assert(OWB_STATS_COMMAND != 0x4E  &&  OWB_STATS_COMMAND != 0xBE  &&  OWB_STATS_COMMAND != 0x48,
+               "OWB_STATS_COMMAND collides with a scratchpad command");
+
+#define OWBStatsHalveBin(i)     OWBStats.WriteHistogram[i] >>= 1
+
+void OWBLLStatsRecordWrite(void)
+{
+    uint8_t bin = OWBLLStatsWriteBin - 1;
+    OWBLLStatsWriteBin = 0;
+
+    if (bin >= OWB_STATS_HISTOGRAM_BINS) {
+        bin = OWB_STATS_HISTOGRAM_BINS - 1;
+    }
+
+    if (OWBStats.WriteHistogram[bin] == 0xFF) {
+        // Unrolled, so that the cost stays fixed (and visible to tools/owb_isr_cycles.py)
+        _Static_assert(OWB_STATS_HISTOGRAM_BINS == 8, "Adjust the halving of the histogram");
+        OWBStatsHalveBin(0);
+        OWBStatsHalveBin(1);
+        OWBStatsHalveBin(2);
+        OWBStatsHalveBin(3);
+        OWBStatsHalveBin(4);
+        OWBStatsHalveBin(5);
+        OWBStatsHalveBin(6);
+        OWBStatsHalveBin(7);
+    }
+    OWBStats.WriteHistogram[bin]++;
+}
+#endif
+
+
+#if defined(OWB_SCRATCHPAD_ENABLED)  ||  defined(OWB_STATS_ENABLED)  ||  defined(OWB_COMP_CHARACTERIZATION_ENABLED)
+// Function commands are interpreted by the ISR
+#define OWB_ISR_FUNCTION_COMMANDS
+#endif
+
+
+#ifdef OWB_ISR_FUNCTION_COMMANDS
+// ********** Function commands handled by the ISR **********
+
+// The ROM code isn't needed anymore once the slave is selected, so its byte index is reused for the function commands.
+#define OWBFunctionByteIndex    OWBROMCodeByteIndex
+
+// Start processing the function command that was just received in CurrentByte
+static void OWBDispatchFunctionCommand(void)
+{
+    OWBFunctionByteIndex = 0;
+    CurrentBitValue++; // CurrentBitValue = 1
+
+    switch (CurrentByte) {
+#ifdef OWB_SCRATCHPAD_ENABLED
+    case 0x4E: // WRITE SCRATCHPAD
+        CurrentState = OWB_STATE_WRITE_SCRATCHPAD;
+        break;
+
+    case 0xBE: // READ SCRATCHPAD
+        CurrentState = OWB_STATE_READ_SCRATCHPAD;
+#ifdef OWB_CRC_ENABLED
+        // The trailing CRC8 only covers the scratchpad itself
+        OWBCRC8 = 0;
+#endif
+        OWBLLSwitchToRead();
+        break;
+
+    case 0x48: // COPY SCRATCHPAD
+        // Leave the actual work to the main loop
+        OWBScratchpadCopyRequest = 1;
+        CurrentState = OWB_STATE_IDLE;
+        break;
+#endif
+
+#ifdef OWB_STATS_ENABLED
+    case OWB_STATS_COMMAND:
+        CurrentState = OWB_STATE_READ_STATS;
+#ifdef OWB_CRC_ENABLED
+        // The trailing CRC8 only covers the statistics themselves
+        OWBCRC8 = 0;
+#endif
+        OWBLLSwitchToRead();
+        break;
+#endif
+
+#ifdef OWB_COMP_CHARACTERIZATION_ENABLED
+    case OWB_COMP_LATENCY_COMMAND:
+        CurrentState = OWB_STATE_READ_COMP_LATENCY;
+#ifdef OWB_CRC_ENABLED
+        OWBCRC8 = 0;
+#endif
+        OWBLLSwitchToRead();
+        break;
+#endif
+
+    default:
+#ifdef OWB_FIFO_ENABLED
+        // Let the main loop handle all other function commands
+        OWBFIFORxPush(CurrentByte);
+        CurrentState = OWB_STATE_FUNCTION;
+#else
+        CurrentState = OWB_STATE_IDLE;
+#endif
+        break;
+    }
+
+    CurrentByte = 0;
+}
+#endif
+
+
+#if defined(OWB_FIFO_ENABLED)  ||  defined(OWB_ISR_FUNCTION_COMMANDS)  ||  defined(OWB_VIRTUAL_SLAVES_ENABLED)
+// Called when the slave has been selected by a ROM command. All following bytes up to the next RST belong to the
+// function command.
+static void OWBSelected(void)
+{
+#ifdef OWB_ISR_FUNCTION_COMMANDS
+    // The function command byte is interpreted by the ISR
+    CurrentState = OWB_STATE_FUNCTION_COMMAND;
+#elif defined(OWB_FIFO_ENABLED)
+    // Everything is passed through the FIFOs
+    CurrentState = OWB_STATE_FUNCTION;
+#else
+    // There are no function commands
+    CurrentState = OWB_STATE_IDLE;
+#endif
+
+#ifdef OWB_VIRTUAL_SLAVES_ENABLED
+    OWBSelectedSlaves = OWBROMParticipants;
+#endif
+
+    CurrentByte = 0;
+    CurrentBitValue = 1;
+
+#ifdef OWB_CRC_ENABLED
+    OWBCRC8 = 0;
+    OWBCRC16 = 0;
+#endif
+
+#ifdef OWB_FIFO_ENABLED
+    // The ISR is the consumer of the TX FIFO, so it may drop responses left over from the previous function command.
+    // The RX FIFO is left to the main loop (see OWBFIFONewTransaction()).
+    OWBFIFOTxTail = OWBFIFOTxHead;
+
+    OWBFIFORxStart = OWBFIFORxHead;
+    OWBFIFOTransaction++;
+#endif
+}
+#else
+// Called when the slave has been selected by a ROM command. There are no function commands without OWB_FIFO_ENABLED or
+// OWB_ISR_FUNCTION_COMMANDS, so there's nothing left to do on the bus until the next RST.
+#define OWBSelected()   CurrentState = OWB_STATE_IDLE
+#endif
+
+
+// Start processing the ROM command that was just received in CurrentByte
+static void OWBDispatchROMCommand(void)
+{
+    uint8_t cmd = OWB_ROM_COMMAND_HASH(CurrentByte);
+    cmd = (OWBROMCommandCodes[cmd] == CurrentByte) ? OWBROMCommandIDs[cmd] : OWB_ROM_CMD_INVALID;
+
+#ifndef OWB_RESUME_DISABLED
+    // Any ROM command except RESUME might select a different slave
+    if (cmd != OWB_ROM_CMD_RESUME) {
+        OWBRESUMEFlag = 0;
+    }
+#endif
+
+#ifdef OWB_VIRTUAL_SLAVES_ENABLED
+    OWBROMParticipants = OWB_VIRTUAL_SLAVES_ALL;
+    // None of them is selected until the command selects them
+    OWBSelectedSlaves = 0;
+#endif
+
+    switch (cmd) {
+#ifndef OWB_READ_ROM_DISABLED
+    case OWB_ROM_CMD_READ_ROM:
+        CurrentState = OWB_STATE_READ_ROM;
+        OWBROMCodeStart();
+
+        OWBLLSwitchToRead();
+        break;
+#endif
+
+#ifdef OWB_ALARM_SEARCH_ENABLED
+    case OWB_ROM_CMD_ALARM_SEARCH:
+        // Exactly like SEARCH ROM, but only slaves with an alarm take part
+#ifdef OWB_VIRTUAL_SLAVES_ENABLED
+        OWBROMParticipants &= OWBAlarmFlag;
+        if (!OWBROMParticipants) {
+#else
+        if (!OWBAlarmFlag) {
+#endif
+            CurrentState = OWB_STATE_IDLE;
+            break;
+        }
+#endif
+#ifndef OWB_SEARCH_ROM_DISABLED
+        // fall through
+    case OWB_ROM_CMD_SEARCH_ROM:
+        CurrentState = OWB_STATE_SEARCH_ROM;
+        OWBROMCodeStart();
+
+        OWBLLSwitchToRead();
+        break;
+#endif
+
+#ifdef OWB_OVERDRIVE_ENABLED
+    case OWB_ROM_CMD_OVERDRIVE_MATCH_ROM:
+        // The ROM code is already sent at overdrive speed. If it doesn't match, we go back to standard speed (unless
+        // we were in overdrive already before).
+        if (!(OWBLLStateFlags & OWB_STATE_FLAG_OVERDRIVE)) {
+            OWBLLStateFlags |= OWB_STATE_FLAG_OVERDRIVE_PENDING;
+            OWBLLSwitchToOverdrive();
+        }
+#endif
+        // fall through
+    case OWB_ROM_CMD_MATCH_ROM:
+        CurrentState = OWB_STATE_MATCH_ROM;
+        OWBROMCodeStart();
+        break;
+
+#ifdef OWB_OVERDRIVE_ENABLED
+    case OWB_ROM_CMD_OVERDRIVE_SKIP_ROM:
+        // All following communication happens at overdrive speed, until the next RESET of standard length.
+        OWBLLSwitchToOverdrive();
+#endif
+        // fall through
+    case OWB_ROM_CMD_SKIP_ROM:
+        // All slaves are selected
+        OWBSelected();
+        break;
+
+#ifndef OWB_RESUME_DISABLED
+    case OWB_ROM_CMD_RESUME:
+        // Select the slave again if it was the last one selected by MATCH ROM or SEARCH ROM
+        if (OWBRESUMEFlag) {
+#ifdef OWB_VIRTUAL_SLAVES_ENABLED
+            OWBROMParticipants = OWBRESUMEFlag;
+#endif
+            OWBSelected();
+        } else {
+            CurrentState = OWB_STATE_IDLE;
+        }
+        break;
+#endif
+
+    default:
+        CurrentState = OWB_STATE_IDLE;
+        break;
+    }
+}
+
 
 void OWBReset(void)
 {
+#ifdef OWB_STATS_ENABLED
+    OWBStats.Resets++;
+#endif
+
     CurrentByte = 0;
     CurrentBitValue = 1;
 
     CurrentState = OWB_STATE_RESET;
 
-    OWBREADROMByteOffset = 0;
-    OWBSEARCHROMCurrentByteIndex = 0;
+    OWBROMCodeByteIndex = 0;
+
+#ifdef OWB_OVERDRIVE_ENABLED
+    // An unfinished OVERDRIVE MATCH ROM counts as a mismatch
+    if (OWBLLStateFlags & OWB_STATE_FLAG_OVERDRIVE_PENDING) {
+        OWBLLStateFlags &= ~(OWB_STATE_FLAG_OVERDRIVE | OWB_STATE_FLAG_OVERDRIVE_PENDING);
+    }
+    OWBLLStateFlags &= ~OWB_STATE_FLAG_DELAYED_SWITCH_TO_OVERDRIVE;
+#endif
+}
+
+void OWBBusFault(void)
+{
+    // Ignore everything until the next RST after the bus is back
+    CurrentState = OWB_STATE_IDLE;
 }
 
 void OWBWriteBit(void)
 {
-    if (CurrentState == OWB_STATE_SEARCH_ROM) {
+#ifdef OWB_CRC_ENABLED
+    OWBCRCUpdate();
+#endif
+
+    switch (CurrentState) {
+#ifdef OWB_VIRTUAL_SLAVES_ENABLED
+    case OWB_STATE_MATCH_ROM:
+        // Virtual slaves whose bit is 1 (only needed here, SEARCH ROM already has it from sending the bit)
+        CurrentByte = OWBROMCodeBits[OWBROMCodeBitIndex] & OWBROMParticipants;
+#ifndef OWB_SEARCH_ROM_DISABLED
+        // fall through
+    case OWB_STATE_SEARCH_ROM:
+#endif
+        // Only the virtual slaves whose bit matches the master's stay in
+        if (OWBLLGetWriteValue()) {
+            OWBROMParticipants = CurrentByte;
+        } else {
+            OWBROMParticipants &= ~CurrentByte;
+        }
+
+        if (OWBROMParticipants == 0) {
+            // Bit mismatch for all of them -> go inactive
+#if defined(OWB_STATS_ENABLED)  &&  !defined(OWB_SEARCH_ROM_DISABLED)
+            if (CurrentState == OWB_STATE_SEARCH_ROM) {
+                OWBStats.SearchROMMismatches++;
+            }
+#endif
+#ifdef OWB_OVERDRIVE_ENABLED
+            // If we only switched to overdrive for this OVERDRIVE MATCH ROM, go back to standard speed
+            if (OWBLLStateFlags & OWB_STATE_FLAG_OVERDRIVE_PENDING) {
+                OWBLLStateFlags &= ~(OWB_STATE_FLAG_OVERDRIVE | OWB_STATE_FLAG_OVERDRIVE_PENDING);
+            }
+#endif
+            CurrentState = OWB_STATE_IDLE;
+            break;
+        }
+
+        OWBROMCodeBitIndex++;
+
+        if (OWBROMCodeBitIndex == 64) {
+            // Command finished -> the remaining virtual slave is selected. The master writes next, so stay in
+            // write-mode.
+#ifdef OWB_OVERDRIVE_ENABLED
+            OWBLLStateFlags &= ~OWB_STATE_FLAG_OVERDRIVE_PENDING;
+#endif
+            OWBRESUMEFlag = OWBROMParticipants;
+            OWBSelected();
+            break;
+        }
+
+#ifndef OWB_SEARCH_ROM_DISABLED
+        if (CurrentState == OWB_STATE_SEARCH_ROM) {
+            OWBLLSwitchToRead();
+        }
+#endif
+        break;
+#else
+#ifndef OWB_SEARCH_ROM_DISABLED
+    case OWB_STATE_SEARCH_ROM:
         if (OWBLLGetWriteValue() == (CurrentByte & 0x01)) {
             // Bit match
 
@@ -75,70 +621,187 @@ void OWBWriteBit(void)
 
             if (CurrentBitValue == 0) {
                 // Byte finished
-                OWBSEARCHROMCurrentByteIndex++;
+                OWBROMCodeByteIndex++;
 
-                if (OWBSEARCHROMCurrentByteIndex == 8) {
-                    // Command finished
-                    CurrentState = OWB_STATE_IDLE;
+                if (OWBROMCodeByteIndex == 8) {
+                    // Command finished -> we're selected. The master writes next, so stay in write-mode.
+                    OWBRESUMEFlag = 1;
+                    OWBSelected();
+                    break;
+                }
+
+                // Next byte
+                CurrentBitValue++; // CurrentBitValue = 1
+                CurrentByte = OWBROMCodeByte(OWBROMCodeByteIndex);
+            }
+
+            OWBLLSwitchToRead();
+        } else {
+            // Bit mismatch -> go inactive
+#ifdef OWB_STATS_ENABLED
+            OWBStats.SearchROMMismatches++;
+#endif
+            CurrentState = OWB_STATE_IDLE;
+        }
+        break;
+#endif
+
+    case OWB_STATE_MATCH_ROM:
+        if (OWBLLGetWriteValue() == (CurrentByte & 0x01)) {
+            // Bit match
+
+            CurrentBitValue <<= 1;
+            CurrentByte >>= 1;
+
+            if (CurrentBitValue == 0) {
+                // Byte finished
+                OWBROMCodeByteIndex++;
+
+                if (OWBROMCodeByteIndex == 8) {
+                    // Command finished -> we're selected
+#ifdef OWB_OVERDRIVE_ENABLED
+                    OWBLLStateFlags &= ~OWB_STATE_FLAG_OVERDRIVE_PENDING;
+#endif
+                    OWBRESUMEFlag = 1;
+                    OWBSelected();
                 } else {
                     // Next byte
                     CurrentBitValue++; // CurrentBitValue = 1
-                    CurrentByte = OWBROMCode[OWBSEARCHROMCurrentByteIndex];
+                    CurrentByte = OWBROMCodeByte(OWBROMCodeByteIndex);
                 }
             }
-
-            OWBLLSwitchToRead();
         } else {
             // Bit mismatch -> go inactive
+#ifdef OWB_OVERDRIVE_ENABLED
+            // If we only switched to overdrive for this OVERDRIVE MATCH ROM, go back to standard speed
+            if (OWBLLStateFlags & OWB_STATE_FLAG_OVERDRIVE_PENDING) {
+                OWBLLStateFlags &= ~(OWB_STATE_FLAG_OVERDRIVE | OWB_STATE_FLAG_OVERDRIVE_PENDING);
+            }
+#endif
             CurrentState = OWB_STATE_IDLE;
         }
-    } else if (CurrentState == OWB_STATE_RESET) {
+        break;
+#endif
+
+#ifdef OWB_FIFO_ENABLED
+    case OWB_STATE_FUNCTION:
         if (OWBLLGetWriteValue()) {
             CurrentByte |= CurrentBitValue;
         }
         CurrentBitValue <<= 1;
 
         if (CurrentBitValue == 0) {
-            // Received command
-
-            if (CurrentByte == 0x33) {
-                // READ ROM
+            // Received byte
+            OWBFIFORxPush(CurrentByte);
 
-                CurrentState = OWB_STATE_READ_ROM;
-
-                CurrentByte = OWBROMCode[0];
-                CurrentBitValue++; // CurrentBitValue = 1
+            CurrentByte = 0;
+            CurrentBitValue++; // CurrentBitValue = 1
 
+            // Responses queued in advance are sent right away
+            if (OWBFIFOTxHead != OWBFIFOTxTail) {
                 OWBLLSwitchToRead();
-            } else if (CurrentByte == 0xF0) {
-                // SEARCH ROM
+            }
+        }
+        break;
+#endif
 
-                CurrentState = OWB_STATE_SEARCH_ROM;
+#ifdef OWB_SCRATCHPAD_ENABLED
+    case OWB_STATE_WRITE_SCRATCHPAD:
+        // Bits go straight into the scratchpad
+        if (OWBLLGetWriteValue()) {
+            OWBScratchpad[OWBFunctionByteIndex] |= CurrentBitValue;
+        } else {
+            OWBScratchpad[OWBFunctionByteIndex] &= ~CurrentBitValue;
+        }
+        CurrentBitValue <<= 1;
 
-                CurrentByte = OWBROMCode[0];
-                CurrentBitValue++; // CurrentBitValue = 1
+        if (CurrentBitValue == 0) {
+            CurrentBitValue++; // CurrentBitValue = 1
+            OWBFunctionByteIndex++;
 
-                OWBLLSwitchToRead();
-            } else {
+            if (OWBFunctionByteIndex == OWB_SCRATCHPAD_SIZE) {
+                // Scratchpad full, ignore the rest
                 CurrentState = OWB_STATE_IDLE;
             }
         }
+        break;
+#endif
+
+#ifdef OWB_ISR_FUNCTION_COMMANDS
+    case OWB_STATE_FUNCTION_COMMAND:
+#endif
+    case OWB_STATE_RESET:
+        if (OWBLLGetWriteValue()) {
+            CurrentByte |= CurrentBitValue;
+        }
+        CurrentBitValue <<= 1;
+
+        if (CurrentBitValue == 0) {
+            // Received command
+#ifdef OWB_ISR_FUNCTION_COMMANDS
+            if (CurrentState == OWB_STATE_FUNCTION_COMMAND) {
+                OWBDispatchFunctionCommand();
+                break;
+            }
+#endif
+            OWBDispatchROMCommand();
+        }
+        break;
     }
 }
 
 void OWBReadBit(void)
 {
-    if (CurrentState == OWB_STATE_SEARCH_ROM) {
+    switch (CurrentState) {
+#ifdef OWB_VIRTUAL_SLAVES_ENABLED
+#ifndef OWB_SEARCH_ROM_DISABLED
+    case OWB_STATE_SEARCH_ROM:
+        // The bus is the wired-AND of all virtual slaves still taking part
         if (OWBLLStateFlags & OWB_STATE_FLAG_SEARCH_ROM_INVERT) {
-            // Send inverted bit
-            OWBLLSetReadValue(~CurrentByte & 0x01);
+            // Inverted bit: 1 only if none of them has a 1 here
+            OWBLLSetReadValue(CurrentByte == 0);
+            OWBLLSwitchToWrite(); // Next is master bit
+        } else {
+            // Bit: 1 only if all of them have a 1 here. CurrentByte keeps the ones that do for the inverted bit and
+            // the master bit.
+            CurrentByte = OWBROMCodeBits[OWBROMCodeBitIndex] & OWBROMParticipants;
+            OWBLLSetReadValue(CurrentByte == OWBROMParticipants);
+        }
+        OWBLLStateFlags ^= OWB_STATE_FLAG_SEARCH_ROM_INVERT; // Toggle inverted bit
+        break;
+#endif
+
+#ifndef OWB_READ_ROM_DISABLED
+    case OWB_STATE_READ_ROM:
+        // Just like on a real bus, all virtual slaves answer at once
+        OWBLLSetReadValue(OWBROMCodeBits[OWBROMCodeBitIndex] == OWB_VIRTUAL_SLAVES_ALL);
+
+        OWBROMCodeBitIndex++;
+
+        if (OWBROMCodeBitIndex == 64) {
+            // All ROM code bits read
+            CurrentState = OWB_STATE_IDLE;
+        }
+        break;
+#endif
+#else
+#ifndef OWB_SEARCH_ROM_DISABLED
+    case OWB_STATE_SEARCH_ROM:
+        if (OWBLLStateFlags & OWB_STATE_FLAG_SEARCH_ROM_INVERT) {
+            // Send inverted bit. Nothing touches the bit value between the two READs, so it still holds the
+            // non-inverted bit sent just before.
+            OWBLLSetReadValue(OWBLLCurrentBitValue ^ 0x01);
             OWBLLSwitchToWrite(); // Next is master bit
         } else {
             // Send non-inverted bit
             OWBLLSetReadValue(CurrentByte & 0x01);
         }
         OWBLLStateFlags ^= OWB_STATE_FLAG_SEARCH_ROM_INVERT; // Toggle inverted bit
-    } else if (CurrentState == OWB_STATE_READ_ROM) {
+        break;
+#endif
+
+#ifndef OWB_READ_ROM_DISABLED
+    case OWB_STATE_READ_ROM:
         OWBLLSetReadValue(CurrentByte & 0x01);
 
         CurrentBitValue <<= 1;
@@ -147,22 +810,213 @@ void OWBReadBit(void)
         if (CurrentBitValue == 0) {
             // Finished reading byte
 
-            OWBREADROMByteOffset++;
+            OWBROMCodeByteIndex++;
 
-            if (OWBREADROMByteOffset == 8) {
+            if (OWBROMCodeByteIndex == 8) {
                 // All ROM code bytes read
                 CurrentState = OWB_STATE_IDLE;
             } else {
                 // Switch to next byte
-                CurrentByte = OWBROMCode[OWBREADROMByteOffset];
+                CurrentByte = OWBROMCodeByte(OWBROMCodeByteIndex);
                 CurrentBitValue++; // CurrentBitValue = 1
             }
         }
-    } else {
+        break;
+#endif
+#endif
+
+#ifdef OWB_FIFO_ENABLED
+    case OWB_STATE_FUNCTION:
+        if (CurrentBitValue == 1) {
+            // Start of byte. The TX FIFO is never empty here, because we only switch to read-mode (or stay in it)
+            // when there's something to send.
+            CurrentByte = OWBFIFOTx[OWBFIFOTxTail & OWB_FIFO_MASK];
+            OWBFIFOTxTail++;
+        }
+
+        OWBLLSetReadValue(CurrentByte & 0x01);
+
+        CurrentBitValue <<= 1;
+        CurrentByte >>= 1;
+
+        if (CurrentBitValue == 0) {
+            // This is the last bit of the byte
+            CurrentBitValue++; // CurrentBitValue = 1
+
+            if (OWBFIFOTxHead == OWBFIFOTxTail) {
+                // Nothing more to send -> the master writes next (unless OWBFIFOTxPut() revokes this in time)
+                OWBLLSwitchToWrite();
+            }
+        }
+        break;
+#endif
+
+#ifdef OWB_SCRATCHPAD_ENABLED
+    case OWB_STATE_READ_SCRATCHPAD:
+        // Bits come straight from the scratchpad
+        OWBLLSetReadValue((OWBScratchpad[OWBFunctionByteIndex] & CurrentBitValue) ? 1 : 0);
+
+        CurrentBitValue <<= 1;
+
+        if (CurrentBitValue == 0) {
+            CurrentBitValue++; // CurrentBitValue = 1
+            OWBFunctionByteIndex++;
+
+            if (OWBFunctionByteIndex == OWB_SCRATCHPAD_SIZE) {
+#ifdef OWB_CRC_ENABLED
+                CurrentState = OWB_STATE_READ_CRC8;
+#else
+                // All bytes read, the master gets 1s from now on
+                CurrentState = OWB_STATE_IDLE;
+#endif
+            }
+        }
+        break;
+#endif
+
+#ifdef OWB_STATS_ENABLED
+    case OWB_STATE_READ_STATS:
+        // Bits come straight from OWBStats. The ISR may update it in between, so this isn't a consistent snapshot.
+        OWBLLSetReadValue((((const volatile uint8_t *) &OWBStats)[OWBFunctionByteIndex] & CurrentBitValue) ? 1 : 0);
+
+        CurrentBitValue <<= 1;
+
+        if (CurrentBitValue == 0) {
+            CurrentBitValue++; // CurrentBitValue = 1
+            OWBFunctionByteIndex++;
+
+            if (OWBFunctionByteIndex == OWB_STATS_SIZE) {
+#ifdef OWB_CRC_ENABLED
+                CurrentState = OWB_STATE_READ_CRC8;
+#else
+                // All bytes read, the master gets 1s from now on
+                CurrentState = OWB_STATE_IDLE;
+#endif
+            }
+        }
+        break;
+#endif
+
+#ifdef OWB_COMP_CHARACTERIZATION_ENABLED
+    case OWB_STATE_READ_COMP_LATENCY:
+        OWBLLSetReadValue((OWBCompLatency[OWBFunctionByteIndex] & CurrentBitValue) ? 1 : 0);
+
+        CurrentBitValue <<= 1;
+
+        if (CurrentBitValue == 0) {
+            CurrentBitValue++; // CurrentBitValue = 1
+            OWBFunctionByteIndex++;
+
+            if (OWBFunctionByteIndex == OWB_COMP_LEVELS) {
+#ifdef OWB_CRC_ENABLED
+                CurrentState = OWB_STATE_READ_CRC8;
+#else
+                // All bytes read, the master gets 1s from now on
+                CurrentState = OWB_STATE_IDLE;
+#endif
+            }
+        }
+        break;
+#endif
+
+#if defined(OWB_ISR_FUNCTION_COMMANDS)  &&  defined(OWB_CRC_ENABLED)
+    case OWB_STATE_READ_CRC8:
+        // Sending the LSB of the CRC and then feeding it into the CRC (see below) just shifts the CRC to the right, so
+        // this sends the whole CRC8 without a copy.
+        OWBLLSetReadValue(OWBCRC8 & 0x01);
+
+        CurrentBitValue <<= 1;
+
+        if (CurrentBitValue == 0) {
+            // CRC sent, the master gets 1s from now on
+            CurrentBitValue++; // CurrentBitValue = 1
+            CurrentState = OWB_STATE_IDLE;
+        }
+        break;
+#endif
+
+    default:
         OWBLLSetReadValue(1);
+        break;
+    }
+
+#ifdef OWB_CRC_ENABLED
+    OWBCRCUpdate();
+#endif
+}
+
+
+#ifdef OWB_FIFO_ENABLED
+bool OWBFIFONewTransaction(void)
+{
+    uint8_t transaction;
+    uint8_t rxStart;
+
+    // The ISR may select the slave again while we're reading these, so make sure we get a consistent pair.
+    do {
+        transaction = OWBFIFOTransaction;
+        rxStart = OWBFIFORxStart;
+    } while (transaction != OWBFIFOTransaction);
+
+    if (transaction == OWBFIFOLastTransaction) {
+        return false;
+    }
+
+    OWBFIFOLastTransaction = transaction;
+    OWBFIFORxTail = rxStart;
+    return true;
+}
+
+uint8_t OWBFIFORxGet(void)
+{
+    uint8_t b = OWBFIFORx[OWBFIFORxTail & OWB_FIFO_MASK];
+    OWBFIFORxTail++;
+    return b;
+}
+
+bool OWBFIFOTxPut(uint8_t b)
+{
+    if (OWBFIFOTxFull()) {
+        return false;
+    }
+
+    OWBFIFOTx[OWBFIFOTxHead & OWB_FIFO_MASK] = b;
+    OWBFIFOTxHead++;
+
+    // The ISR might be just about to switch to write-mode because it ran out of bytes to send. The interrupt is
+    // disabled only for a few instructions, far less than the time between the falling edge of a READ and the
+    // master's sampling point.
+    __disgint();
+    if (CurrentState == OWB_STATE_FUNCTION) {
+        if (OWBLLStateFlags & OWB_STATE_FLAG_NEXT_IS_READ) {
+            // Keep on sending after the current byte
+            OWBLLStateFlags &= ~OWB_STATE_FLAG_DELAYED_SWITCH_TO_WRITE;
+        } else {
+            // Start sending with the next READ. Drop any partially received byte, which shouldn't exist if the
+            // application follows the function command protocol.
+            CurrentBitValue = 1;
+            OWBLLSwitchToRead();
+        }
     }
+    __engint();
+
+    return true;
 }
+#endif
 
+#ifdef OWB_CRC_ENABLED
+uint16_t OWBCRC16Get(void)
+{
+    uint16_t crc;
+
+    // The ISR may update it between reading the two bytes
+    __disgint();
+    crc = OWBCRC16;
+    __engint();
+
+    return crc;
+}
+#endif
 
 
 
@@ -172,22 +1026,277 @@ void OWBReadBit(void)
 // *                                                        *
 // **********************************************************
 
+#ifdef OWB_CALIBRATION_ENABLED
+// Replace the default latency in one of the OWB_TIMING_* constants with the measured one
+static uint16_t OWBLLAdjustTiming(uint16_t ticks)
+{
+    ticks += OWB_TIMING_LOW_TO_ISR_LATENCY_TICKS;
+    return (ticks > OWBLLLatencyTicks) ? (ticks - OWBLLLatencyTicks) : 0;
+}
+
+#define OWB_TIMING_LOAD_STD(name)   OWBLLTimingStd.name = OWBLLAdjustTiming(OWB_TIMING_##name);
+#define OWB_TIMING_LOAD_OD(name)    OWBLLTimingOD.name = OWBLLAdjustTiming(OWB_TIMING_OD_##name);
+
+void OWBLLLoadTiming(void)
+{
+    OWB_TIMING_NAMES(OWB_TIMING_LOAD_STD)
+#ifdef OWB_OVERDRIVE_ENABLED
+    OWB_TIMING_NAMES(OWB_TIMING_LOAD_OD)
+#endif
+
+#ifdef OWB_CALIBRATION_LEARN_MASTER
+    OWBLLTimingStd.MASTER_W1 = 0;
+#ifdef OWB_OVERDRIVE_ENABLED
+    OWBLLTimingOD.MASTER_W1 = 0;
+#endif
+#endif
+}
+
+#ifdef OWB_CALIBRATION_LEARN_MASTER
+void OWBLLLearnW1(void)
+{
+    struct OWBLLTimingTable* table = &OWBLLTimingStd;
+    uint16_t w0Max = OWBLLAdjustTiming(OWB_TIMING_W0_0_MIN);
+#ifdef OWB_OVERDRIVE_ENABLED
+    if (OWBLLStateFlags & OWB_STATE_FLAG_OVERDRIVE) {
+        table = &OWBLLTimingOD;
+        w0Max = OWBLLAdjustTiming(OWB_TIMING_OD_W0_0_MIN);
+    }
+#endif
+
+    if (T16Value <= table->MASTER_W1) {
+        return;
+    }
+    table->MASTER_W1 = T16Value;
+
+    // WRITE0 is anything at least twice as long as the longest WRITE1, but never later than the constant says, and
+    // never earlier than half of that (in case of glitches).
+    uint16_t w0Min = T16Value << 1;
+    if (w0Min > w0Max) {
+        w0Min = w0Max;
+    } else if (w0Min < (w0Max >> 1)) {
+        w0Min = w0Max >> 1;
+    }
+    table->W0_0_MIN = w0Min;
+}
+#endif
+
+// Pull the bus LOW ourselves a few times, and return the longest time it took for the IRQ flag to appear, in T16 ticks.
+// This includes a few cycles for the measurement loop itself, which are roughly what the interrupt entry would take.
+static uint16_t OWBLLMeasureLatency(void)
+{
+    uint16_t latency = 0;
+
+    for (uint8_t i = 0 ; i < OWB_CALIBRATION_RUNS ; i++) {
+        // Wait for the bus to be idle
+        while (!OWBLLGetValue());
+
+        // T16 raises its IRQ flag after OWB_CALIBRATION_TIMEOUT_TICKS, in case the edge is never seen
+        T16C = 0;
+        INTRQ &= ~(OWB_LOW_DETECT_IRQ_FLAG | INTRQ_T16);
+        T16M |= T16M_CLK_SYSCLK;
+        OWBLLSetLow();
+        while (!(INTRQ & (OWB_LOW_DETECT_IRQ_FLAG | INTRQ_T16)));
+        OWBLLGetT16Value();
+        OWBLLSetInput();
+        T16M &= (uint8_t) ~T16M_CLK_SYSCLK;
+
+        if (!(INTRQ & OWB_LOW_DETECT_IRQ_FLAG)) {
+            T16Value = OWB_CALIBRATION_TIMEOUT_TICKS;
+        }
+        if (T16Value > latency) {
+            latency = T16Value;
+        }
+    }
+
+    T16C = 0;
+    INTRQ &= ~(OWB_LOW_DETECT_IRQ_FLAG | INTRQ_T16);
+
+    latency += OWB_CALIBRATION_ISR_ENTRY_TICKS;
+    return (latency > 0xFF) ? 0xFF : latency;
+}
+
+void OWBCalibrate(void)
+{
+#ifdef OWB_COMP_CHARACTERIZATION_ENABLED
+    // Sweep the comparator's reference through its range, and return to the configured level for the measurement below
+    for (uint8_t level = 0 ; level < OWB_COMP_LEVELS ; level++) {
+        OWBLLSetCompLevel(level);
+        OWBCompLatency[level] = (uint8_t) OWBLLMeasureLatency();
+    }
+    OWBLLSetCompLevel(OWB_COMP_LEVEL);
+#endif
+
+    OWBLLLatencyTicks = (uint8_t) OWBLLMeasureLatency();
+    OWBLLLoadTiming();
+
+#ifdef OWB_IDLE_ENABLED
+    // Let T16 wake the core up from stopexe, and see how far it counted beyond that. The core has to start up the same
+    // way after an edge on the bus. Runs that were cut short by an edge on the bus don't count.
+    uint16_t wakeup = 0;
+
+    for (uint8_t i = 0 ; i < OWB_CALIBRATION_RUNS ; i++) {
+        OWBLLStartT16Timeout(OWB_CALIBRATION_IDLE_TIMEOUT_TICKS);
+        OWBLLSetT16IntSrc(OWB_T16_INT_SRC);
+        __stopexe();
+        OWBLLGetT16Value();
+        T16M = T16M_CLK_DISABLE | T16M_CLK_DIV1 | OWB_T16_INT_SRC;
+
+        if (T16Value >= (1u << OWB_T16_INT_BIT)  &&  T16Value - (1u << OWB_T16_INT_BIT) > wakeup) {
+            wakeup = T16Value - (1u << OWB_T16_INT_BIT);
+        }
+    }
+
+    T16C = 0;
+    INTRQ &= ~(INTRQ_T16 | OWB_LOW_DETECT_IRQ_FLAG);
+
+    OWBLLIdleWakeupTicks = (wakeup > 0xFF) ? 0xFF : (uint8_t) wakeup;
+#endif
+}
+#endif
+
+_Static_assert(OWB_TIMING_RST_1 < (1u << OWB_T16_INT_BIT)  &&  OWB_TIMING_RST_PP < (1u << OWB_T16_INT_BIT),
+               "RST timing too long for the T16 interrupt source");
+
+#ifdef OWB_SECOND_BUS_ENABLED
+// State of one bus, as X(type, name) of the global variable that holds it while the bus is the current one
+#ifdef OWB_CRC_ENABLED
+#define OWB_BUS_STATE_CRC(X)                X(uint8_t, OWBCRC8) X(uint16_t, OWBCRC16)
+#else
+#define OWB_BUS_STATE_CRC(X)
+#endif
+#ifdef OWB_VIRTUAL_SLAVES_ENABLED
+#define OWB_BUS_STATE_VIRTUAL_SLAVES(X)     X(uint8_t, OWBROMParticipants)
+#else
+#define OWB_BUS_STATE_VIRTUAL_SLAVES(X)
+#endif
+#define OWB_BUS_STATE(X)                                                                                \
+        X(uint8_t, OWBLLStateFlags) X(uint8_t, OWBLLNextRead0INTRQFlag) X(uint8_t, OWBLLCurrentBitValue)   \
+        X(uint8_t, OWBLLResetPhase)                                                                     \
+        X(uint8_t, CurrentState) X(uint8_t, CurrentByte) X(uint8_t, CurrentBitValue)                    \
+        X(uint8_t, OWBROMCodeByteIndex) X(uint8_t, OWBRESUMEFlag)                                       \
+        OWB_BUS_STATE_CRC(X) OWB_BUS_STATE_VIRTUAL_SLAVES(X)
+
+#define OWB_BUS_STATE_ENTRY(type, name)     type name;
+#define OWB_BUS_STATE_SWAP(type, name)      { type tmp = name; name = OWBLLOtherBus.name; OWBLLOtherBus.name = tmp; }
+
+struct OWBLLBusState
+{
+    OWB_BUS_STATE(OWB_BUS_STATE_ENTRY)
+};
+
+// State of the bus that isn't the current one
+static struct OWBLLBusState OWBLLOtherBus;
+
+void OWBLLSwitchBus(void)
+{
+    OWB_BUS_STATE(OWB_BUS_STATE_SWAP)
+}
+#endif
+
+void OWBLLResetStep(void)
+{
+    if (OWBLLResetPhase == OWB_RESET_PHASE_WAIT_IDLE) {
+        // Clear the flag before checking the bus, so that we can't miss the rising edge
+        INTRQ &= ~OWB_LOW_DETECT_IRQ_FLAG;
+
+        if (OWBLLGetValue()) {
+            // End of the RST LOW pulse. Leave bus idle for a while before the presence pulse. Our own presence pulse
+            // would trigger the OWB interrupt, so only listen to T16 until the RST is over.
+            OWBLLSetT16IntSrc(OWB_T16_INT_SRC);
+            OWBLLStartT16Timeout(OWB_TIMING(RST_1));
+            INTRQ &= ~INTRQ_T16;
+            INTEN = INTEN_T16;
+            OWBLLResetPhase = OWB_RESET_PHASE_IDLE;
+        } else if (INTRQ & INTRQ_T16) {
+            // Still LOW after the fault timeout -> bus fault. Stop the timer, and just wait for the bus to come back.
+            T16M = T16M_CLK_DISABLE | T16M_CLK_DIV1 | OWB_T16_INT_SRC;
+            T16C = 0;
+            INTRQ &= ~INTRQ_T16;
+            INTEN = OWB_LOW_DETECT_INT_ENABLE;
+            OWBBusFault();
+            OWBLLResetPhase = OWB_RESET_PHASE_BUS_FAULT;
+        }
+    } else if (OWBLLResetPhase == OWB_RESET_PHASE_BUS_FAULT) {
+        INTRQ &= ~OWB_LOW_DETECT_IRQ_FLAG;
+
+        if (OWBLLGetValue()) {
+            // The bus is back. Don't send a presence pulse, the master will have to start with a proper RST.
+            // The ISR has started the timer again on entry.
+            T16M &= (uint8_t) ~T16M_CLK_SYSCLK;
+            T16C = 0;
+
+            OWBLLIntOnFalling();
+            INTRQ &= ~OWB_LOW_DETECT_IRQ_FLAG;
+            INTEN = OWB_IDLE_INT_ENABLE;
+
+            OWBLLResetPhase = OWB_RESET_PHASE_NONE;
+        }
+    } else if (INTRQ & INTRQ_T16) {
+        INTRQ &= ~INTRQ_T16;
+
+        if (OWBLLResetPhase == OWB_RESET_PHASE_IDLE) {
+            // Send presence pulse
+            OWBLLStartT16Timeout(OWB_TIMING(RST_PP));
+            OWBLLSetLow();
+#ifdef OWB_STATS_ENABLED
+            OWBStats.PresencePulses++;
+#endif
+            OWBLLResetPhase = OWB_RESET_PHASE_PRESENCE;
+        } else {
+            // End of presence pulse
+            OWBLLSetInput();
+
+            // RST complete -> disable and reset timer, and wait for the next LOW pulse again
+            T16M &= (uint8_t) ~T16M_CLK_SYSCLK;
+            T16C = 0;
+
+            OWBLLIntOnFalling();
+            // Reset IRQ signal again. Our own presence pulse will have falsely set it.
+            INTRQ &= ~OWB_LOW_DETECT_IRQ_FLAG;
+            INTEN = OWB_IDLE_INT_ENABLE;
+
+            OWBLLResetPhase = OWB_RESET_PHASE_NONE;
+        }
+    }
+}
+
 void OWBInit(void)
 {
     PADIER = 0;
 
-#ifdef OWB_INT_USE_COMP
+#ifdef OWB_FIFO_ENABLED
+    OWBFIFORxHead = OWBFIFORxTail = 0;
+    OWBFIFOTxHead = OWBFIFOTxTail = 0;
+    OWBFIFOTransaction = OWBFIFOLastTransaction = 0;
+#endif
+
+#ifdef OWB_ROM_CODE_IN_RAM
+    for (uint8_t i = 0 ; i < 8 ; i++) {
+        OWBROMCodeRAM[i] = OWBROMCode[i];
+    }
+#endif
+
+#if defined(OWB_INT_USE_COMP)  ||  defined(OWB_SECOND_BUS_ENABLED)
+    // The comparator watches the OWB pin, or the pin of bus 1 with OWB_SECOND_BUS_ENABLED
+#ifdef OWB_SECOND_BUS_ENABLED
+#define OWB_COMP_Px     OWB_BUS1_Px
+#define OWB_COMP_PIN    OWB_BUS1_PIN
+#else
+#define OWB_COMP_Px     OWB_Px
+#define OWB_COMP_PIN    OWB_PIN
+#endif
     // Setup comparator to simply output the digital value of its minus input to its output.
     GPCC = 0; // Disable comparator
     // IMPORTANT: GPCS is a WRITE-ONLY register, so set it up in one go.
-    GPCS = GPCS_COMP_RANGE2 | (15 << GPCS_COMP_VOLTAGE_LVL_BIT0); // Vintr = 0.125*Vdd
-#if OWB_Px == PA  &&  OWB_PIN == 3
+    OWBLLSetCompLevel(OWB_COMP_LEVEL);
+#if OWB_COMP_Px == PA  &&  OWB_COMP_PIN == 3
     GPCC = GPCC_COMP_PLUS_VINT_R | GPCC_COMP_MINUS_PA3 | GPCC_COMP_OUT_INVERT | GPCC_COMP_ENABLE;
-#elif OWB_Px == PA  &&  OWB_PIN == 4
+#elif OWB_COMP_Px == PA  &&  OWB_COMP_PIN == 4
     GPCC = GPCC_COMP_PLUS_VINT_R | GPCC_COMP_MINUS_PA4 | GPCC_COMP_OUT_INVERT | GPCC_COMP_ENABLE;
-#elif OWB_Px == PB  &&  OWB_PIN == 6
+#elif OWB_COMP_Px == PB  &&  OWB_COMP_PIN == 6
     GPCC = GPCC_COMP_PLUS_VINT_R | GPCC_COMP_MINUS_PB6 | GPCC_COMP_OUT_INVERT | GPCC_COMP_ENABLE;
-#elif OWB_Px == PB  &&  OWB_PIN == 7
+#elif OWB_COMP_Px == PB  &&  OWB_COMP_PIN == 7
     GPCC = GPCC_COMP_PLUS_VINT_R | GPCC_COMP_MINUS_PB7 | GPCC_COMP_OUT_INVERT | GPCC_COMP_ENABLE;
 #else
 #error Invalid OWB pin: Must be configurable as minus input of comparator.
@@ -202,30 +1311,36 @@ void OWBInit(void)
     // Output value will always be LOW, because we want an open-drain port
     OWBLLSetInput();
     OWB_Px &= ~(1 << OWB_PIN);
+#ifdef OWB_SECOND_BUS_ENABLED
+    OWB_BUS1_PxC &= ~(1 << OWB_BUS1_PIN);
+    OWB_BUS1_Px &= ~(1 << OWB_BUS1_PIN);
+
+    // Bus 1 starts out idle, just like bus 0
+    OWBLLOtherBus.OWBLLStateFlags = OWB_STATE_FLAG_BUS1;
+    OWBLLOtherBus.OWBLLNextRead0INTRQFlag = 0;
+    OWBLLOtherBus.OWBLLResetPhase = OWB_RESET_PHASE_NONE;
+    OWBLLOtherBus.CurrentState = OWB_STATE_IDLE;
+    OWBLLOtherBus.CurrentBitValue = 1;
+    OWBLLOtherBus.OWBRESUMEFlag = 0;
+#endif
 
-    // Setup timer to tick at F_CPU, but disable it for now. Also reset it to 0
-    T16M = T16M_CLK_DISABLE | T16M_CLK_DIV1;
+    // Setup timer to tick at F_CPU, but disable it for now. Also reset it to 0. Its interrupt is only enabled while
+    // timing the phases of a RST.
+    T16M = T16M_CLK_DISABLE | T16M_CLK_DIV1 | OWB_T16_INT_SRC;
     T16C = 0;
 
-    INTRQ = 0;
-#ifdef OWB_INT_USE_COMP
-    // Setup interrupt on COMP rising edge (i.e. OWB pin falling edge), and enable it
-#ifdef INTEGS_COMP_FALLING
-    // IMPORTANT: INTEGS is a WRITE-ONLY register, so set it up in one go.
-    INTEGS = INTEGS_COMP_FALLING;
-#elif defined(MISC2_COMP_EDGE_INT_FALL)
-    // IMPORTANT: INTEGS and MISC2 are WRITE-ONLY registers, so set them up in one go.
-    INTEGS = 0;
-    MISC2 = MISC2_COMP_EDGE_INT_FALL;
-#else
-#error Unable to select falling edge as COMP interrupt condition. Neither INTEGS nor MISC2 is supported.
+    OWBLLResetPhase = OWB_RESET_PHASE_NONE;
+
+#ifdef OWB_CALIBRATION_ENABLED
+    // Use the default latency until OWBCalibrate() is called
+    OWBLLLoadTiming();
 #endif
-    INTEN = INTEN_COMP;
-#else
+
+    INTRQ = 0;
     // Setup interrupt on OWB pin falling edge, and enable it
-    // IMPORTANT: INTEGS is a WRITE-ONLY register, so set it up in one go.
-    INTEGS = INTEGS_PA0_FALLING;
-    INTEN = INTEN_PA0;
+    OWBLLIntOnFalling();
+    INTEN = OWB_IDLE_INT_ENABLE;
+#ifndef OWB_INT_USE_COMP
 #ifdef ROP
 #if OWB_Px == PA  &&  OWB_PIN == 5
     ROP = ROP_INT_SRC_PA5;
@@ -241,3 +1356,41 @@ void OWBInit(void)
 #endif
 #endif
 }
+
+
+#ifdef OWB_IDLE_ENABLED
+void OWBIdle(void)
+{
+#ifdef OWB_CALIBRATION_ENABLED
+    if (OWBLLIdleWakeupTicks > OWB_IDLE_WAKEUP_BUDGET_TICKS) {
+        // Waking up would take too long even for a RST
+        return;
+    }
+#endif
+
+    // With interrupts disabled, the ISR can't change any of this between the checks and stopexe. An edge still wakes
+    // the core up, and its interrupt is taken as soon as they're enabled again.
+    __disgint();
+
+    // OWBReadBit() already switches to OWB_STATE_IDLE when it buffers the last bit of a read, so that bit may still be
+    // waiting for its slot. A buffered READ0 has to make it into the READ0 budget. Once no data bit is left, the
+    // master just gets 1s, which don't need the bus pulled low.
+    if (CurrentState == OWB_STATE_IDLE  &&  OWBLLResetPhase == OWB_RESET_PHASE_NONE  &&  !OWBLLNextRead0INTRQFlag
+#ifdef OWB_SECOND_BUS_ENABLED
+            &&  OWBLLOtherBus.CurrentState == OWB_STATE_IDLE  &&  OWBLLOtherBus.OWBLLResetPhase == OWB_RESET_PHASE_NONE
+            &&  !OWBLLOtherBus.OWBLLNextRead0INTRQFlag
+#endif
+#ifdef OWB_FIFO_ENABLED
+            &&  !OWBFIFORxAvailable()  &&  OWBFIFOTransaction == OWBFIFOLastTransaction
+#endif
+#ifdef OWB_SCRATCHPAD_ENABLED
+            &&  !OWBScratchpadCopyRequest
+#endif
+            // An edge that came in before interrupts were disabled wouldn't wake the core up again
+            &&  !(INTRQ & INTEN)) {
+        __stopexe();
+    }
+
+    __engint();
+}
+#endif
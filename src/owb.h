@@ -28,28 +28,214 @@
 // *                                                        *
 // **********************************************************
 
+// The feature switches below can either be enabled here, or through the CMake option of the same name (see
+// OWB_FEATURE_OPTIONS in CMakeLists.txt), which also reports what each of them costs in code and RAM.
+
 // Enable this to use the comparator peripheral for the OWB interrupt. If enabled, the OWB pin must be one that can
 // be used as the minus input to the comparator. If disabled, the OWB pin must be one that can be used as an external
 // interrupt pin directly.
 //#define OWB_INT_USE_COMP
 
+// Reference voltage of the comparator (with OWB_INT_USE_COMP, or for bus 1 with OWB_SECOND_BUS_ENABLED), as the range
+// and level written to GPCS. The interrupt fires when a falling edge crosses it, so on the slow edges of long,
+// capacitive buses, a higher reference fires earlier and leaves more of the READ0 budget to the ISR. It must stay well
+// above the LOW level of the bus though, and below the level it recovers to between slots. OWB_COMP_THRESHOLD_PERMILLE
+// is the resulting voltage in 1/1000 of Vdd (see the comparator chapter in the datasheet of the device), which the
+// default interrupt latency follows (see OWB_COMP_EDGE_DELAY_TICKS). The default is 0.125*Vdd.
+#define OWB_COMP_RANGE                  GPCS_COMP_RANGE2
+#define OWB_COMP_LEVEL                  15
+#define OWB_COMP_THRESHOLD_PERMILLE     125
+
+// Time a falling edge on the bus takes from Vdd down to GND in nanoseconds, as seen at the slave. With
+// OWB_INT_USE_COMP, the part of it until the comparator's reference is reached is added to the interrupt latency. 0
+// for buses with steep edges. The READ0 budget shrinks by the same amount, which tools/owb_isr_cycles.py accounts for.
+// Like OWB_COMP_THRESHOLD_PERMILLE, it must be a plain number (see OWBExportValue()).
+#define OWB_BUS_FALL_TIME_NS            0
+
+// Enable this (together with OWB_INT_USE_COMP and OWB_CALIBRATION_ENABLED) to have OWBCalibrate() measure the latency
+// at each of the 16 levels of OWB_COMP_RANGE, before measuring the one of OWB_COMP_LEVEL as usual. The results can be
+// read with the function command OWB_COMP_LATENCY_COMMAND: One byte per level in T16 ticks, 0xFF if the edge wasn't
+// seen in time (followed by a CRC8 with OWB_CRC_ENABLED). The slave pulls the bus low itself for this, so the edges are
+// as steep as its own driver makes them. This is meant for choosing OWB_COMP_LEVEL for a bus, and costs 16 bytes of
+// RAM.
+//#define OWB_COMP_CHARACTERIZATION_ENABLED
+
+// Function command that reads the results of OWB_COMP_CHARACTERIZATION_ENABLED. Must not collide with the scratchpad
+// commands or OWB_STATS_COMMAND.
+#define OWB_COMP_LATENCY_COMMAND        0xD8
+
 // Enable this to check the minimum LOW pulse length for the shortest 1-Wire operations (W1, R). This can be useful
 // to skip short glitches on the bus. When disabled, even short LOW pulses will be interpreted as 1-Wire operations.
 // The latter can be useful if the master sends pulses shorter than what the slave's ISR can handle (i.e. R pulses
 // of less than 5us).
 //#define OWB_SKIP_SHORT_PULSES
 
+// Enable this to support overdrive speed (OVERDRIVE SKIP ROM and OVERDRIVE MATCH ROM). Overdrive time slots are about
+// 8 times shorter than standard speed ones, so this needs at least 8MHz. Even then, READ0 is only answered in time if
+// the master samples the bus late in the slot, because the interrupt latency alone eats most of the budget.
+//#define OWB_OVERDRIVE_ENABLED
+
+// Defined by the build if OWB_VIRTUAL_ROM_CODES is set in CMake: The device then appears as one 1-Wire slave per ROM
+// code in that list (at most 8), instead of using the serial number programmed by easypdkprog. READ ROM, SEARCH ROM
+// and MATCH ROM handle all of them at once: Each virtual slave still taking part is one bit in a mask, and the ISR
+// looks up one bit of every ROM code at a time in a transposed table, so the cost per bit doesn't grow with the number
+// of virtual slaves. The slaves selected for a function command can be found in OWBSelectedSlaves, which is 0 after a
+// ROM command that selected none of them. All of them share the scratchpad, the FIFOs and the CRCs.
+//#define OWB_VIRTUAL_SLAVES_ENABLED
+
+// Enable this to support ALARM SEARCH (0xEC). It works exactly like SEARCH ROM, but the slave only takes part while
+// the application has set OWBAlarmFlag (see OWBSetAlarm()). With OWB_VIRTUAL_SLAVES_ENABLED, each bit of OWBAlarmFlag
+// is the alarm of one virtual slave.
+//#define OWB_ALARM_SEARCH_ENABLED
+
+// Enable these to leave out ROM commands that aren't needed, e.g. SEARCH ROM and RESUME on a bus with a single slave.
+// This saves the code for the command and its states. OWB_ALARM_SEARCH_ENABLED needs SEARCH ROM.
+//#define OWB_READ_ROM_DISABLED
+//#define OWB_SEARCH_ROM_DISABLED
+//#define OWB_RESUME_DISABLED
+
+// On by default: OWBInit() copies the ROM code from code space to RAM. Fetching a byte from the serial number table in
+// code space is considerably slower than fetching it from RAM, and it happens inside the ISR at every byte boundary of
+// READ ROM, SEARCH ROM and MATCH ROM. This costs 8 bytes of RAM, which is 1/8 of it on the smallest devices, so define
+// OWB_ROM_CODE_IN_CODE_SPACE to serve the ROM code from code space if RAM is tight.
+#ifndef OWB_ROM_CODE_IN_CODE_SPACE
+#define OWB_ROM_CODE_IN_RAM
+#endif
+
+// Enable this to exchange the bytes of function commands (everything after the ROM command that selected the slave)
+// with the main loop through two lock-free FIFOs. The ISR only shifts bits into and out of bytes, while the main loop
+// interprets the received bytes (see OWBFIFORxGet()) and queues the responses (see OWBFIFOTxPut()). This keeps any
+// real work out of the ISR, so it can't make the slave miss the next READ0.
+//#define OWB_FIFO_ENABLED
+
+// Size of each of the two FIFOs in bytes. Must be a power of 2, and at most 128.
+#define OWB_FIFO_SIZE   4
+
+// Enable this to handle the function commands WRITE SCRATCHPAD (0x4E), READ SCRATCHPAD (0xBE) and COPY SCRATCHPAD
+// (0x48) inside the ISR. The bits are shifted directly into and out of OWBScratchpad, which the application must
+// define. COPY SCRATCHPAD only sets OWBScratchpadCopyRequest for the main loop. With OWB_FIFO_ENABLED, all other
+// function commands are passed to the main loop through the FIFOs.
+//#define OWB_SCRATCHPAD_ENABLED
+
+// Size of the scratchpad in bytes
+#define OWB_SCRATCHPAD_SIZE     8
+
+// Enable this to keep a Dallas CRC8 (OWBCRC8) and CRC16 (OWBCRC16) over all bits of the current function command,
+// including the function command byte itself. They are updated one bit at a time in OWBWriteBit() and OWBReadBit(),
+// so they are complete as soon as the last bit of the payload went over the bus, and no byte boundary has to pay for a
+// whole byte's worth of CRC. With OWB_SCRATCHPAD_ENABLED, READ SCRATCHPAD then sends the CRC8 of the scratchpad after
+// its last byte, like a DS18B20 does.
+//#define OWB_CRC_ENABLED
+
+// Enable this to keep statistics about the bus in OWBStats (see struct OWBStats), which the master can read with the
+// function command OWB_STATS_COMMAND, e.g. to poll the health of a whole fleet of slaves. The ISR only updates a few
+// counters, and the histogram of WRITE decisions costs one call to OWBLLStatsRecordWrite() per WRITE slot, after the
+// WRITE has been handled (see the "Statistics" result of tools/owb_isr_cycles.py). Without OWB_SECOND_BUS_ENABLED or
+// OWB_SKIP_SHORT_PULSES, counting late READ0s costs 2 cycles before the bus is pulled low for READ0. Costs 18 bytes of
+// RAM.
+//#define OWB_STATS_ENABLED
+
+// Function command that reads OWBStats, with a trailing CRC8 if OWB_CRC_ENABLED. Must not collide with the scratchpad
+// commands.
+#define OWB_STATS_COMMAND       0xD7
+
+// Enable this to service the bus from a busy-waiting loop in main() instead of from the interrupt. This avoids the
+// interrupt entry latency and saving registers, so READ0 can be answered in time even for masters with very short
+// READ pulses at 4MHz. The price is that main() never returns to do anything else, so this can't be combined with
+// OWB_FIFO_ENABLED.
+//#define OWB_POLLING_MODE
+
+// Enable this to measure the latency from a falling edge on the bus to the start of T16 in the ISR at startup (see
+// OWBCalibrate()), instead of relying on OWB_TIMING_LOW_TO_ISR_LATENCY_TICKS. The latency differs quite a bit between
+// the pin interrupt and OWB_INT_USE_COMP, and between devices. The slot timing thresholds are then kept in RAM (12
+// bytes, twice that with OWB_OVERDRIVE_ENABLED). NOTE: The measurement briefly pulls the bus LOW a few times.
+//#define OWB_CALIBRATION_ENABLED
+
+// Enable this (together with OWB_CALIBRATION_ENABLED) to learn the length of the master's WRITE1 pulses, and recognize
+// WRITE0 as soon as a LOW pulse is twice as long, instead of waiting for OWB_TIMING_W0_0_MIN. This leaves more of the
+// slot to OWBWriteBit() for masters with short WRITE1 pulses. The threshold never drops below half of
+// OWB_TIMING_W0_0_MIN.
+//#define OWB_CALIBRATION_LEARN_MASTER
+
+// Enable this to stop the core with stopexe from the main loop (see OWBIdle()) while the slave has nothing to do, to
+// save power on parasitically or battery powered nodes. The next edge on the bus wakes it up again, which delays the
+// ISR by up to OWB_IDLE_WAKEUP_TICKS. That doesn't fit into the READ0 budget, so the core is only stopped while every
+// bus is in OWB_STATE_IDLE, with no READ0 still buffered and no RST in progress: The next slot that matters is then a
+// RST, which tolerates up to OWB_IDLE_WAKEUP_BUDGET_TICKS of delay. The system clock keeps running in stopexe, so
+// waking up only takes a few cycles. With OWB_CALIBRATION_ENABLED, OWBCalibrate() measures the wake-up time at the
+// actual F_CPU, and the core isn't stopped at all if it exceeds the budget. Can't be combined with OWB_POLLING_MODE.
+//#define OWB_IDLE_ENABLED
+
+// Enable this to serve a second, independent 1-Wire bus (bus 1) on OWB_BUS1_PIN, which is watched by the comparator,
+// while the OWB pin (bus 0) uses the pin interrupt. Each bus has its own low-level and high-level state (reset phase,
+// speed, ROM command progress, CRCs), and the ISR swaps them in and out as the buses need it (see OWBLLSwitchBus()).
+// There is only one T16 and one ISR though, so only one bus is served at a time:
+//  - A falling edge on the other bus is only handled after the current slot (up to ~60us at standard speed), or after
+//    the whole RST of the current bus (its LOW pulse plus ~165us). A slot that arrives in that time is measured from
+//    the start of the ISR instead of from its falling edge, so it may be misread. A RST still resynchronizes the bus,
+//    as long as it doesn't wait for more than ~280us.
+//  - Swapping the state in costs ~60 cycles before the READ0 fast path, so a READ0 on the bus that wasn't the last one
+//    served misses the master's LOW pulse. The bus may go HIGH for a moment before the slave pulls it low, and the
+//    bit is only read correctly if that happens before the master samples it (~15us at standard speed). The build
+//    checks this path against OWB_READ0_SWITCH_BUDGET_US instead of OWB_READ0_BUDGET_US. Overdrive samples too early.
+//  - While one bus is stuck LOW (see OWBBusFault()), the other one isn't served at all until it comes back.
+//  - The scratchpad, OWBSelectedSlaves, OWBAlarmFlag and the scratch variable T16Value are shared between the buses.
+//    OWBCRC16Get() returns the CRC of whichever bus was served last.
+// Can't be combined with OWB_INT_USE_COMP, OWB_POLLING_MODE, OWB_FIFO_ENABLED, OWB_SKIP_SHORT_PULSES or
+// OWB_CALIBRATION_ENABLED.
+//#define OWB_SECOND_BUS_ENABLED
+
 // Configuration for the OWB pin
 #define OWB_PxC     PAC
 #define OWB_Px      PA
 #define OWB_PIN     0
 
+// Configuration for the pin of bus 1 with OWB_SECOND_BUS_ENABLED. Must be configurable as minus input of the
+// comparator.
+#ifdef OWB_SECOND_BUS_ENABLED
+#define OWB_BUS1_PxC    PAC
+#define OWB_BUS1_Px     PA
+#define OWB_BUS1_PIN    4
+#endif
+
 // Configuration for the debug pin
 //#define OWB_DEBUG_ENABLED
 #ifdef OWB_DEBUG_ENABLED
 #define DBG_PxC     PAC
 #define DBG_Px      PA
 #define DBG_PIN     4
+
+// Enable this to emit a trace of events on the debug pin (see DbgEvent()), instead of just a pulse for each READ0. Each
+// event costs a fixed number of cycles, so the ISR's timing shifts predictably, but it does shift: Check the results
+// of tools/owb_isr_cycles.py with this enabled. tools/sigrok/owb_trace decodes the trace.
+//#define OWB_DEBUG_TRACE
+#endif
+#if defined(OWB_DEBUG_TRACE)  &&  !defined(OWB_DEBUG_ENABLED)
+#error OWB_DEBUG_TRACE needs the debug pin of OWB_DEBUG_ENABLED
+#endif
+#if defined(OWB_COMP_CHARACTERIZATION_ENABLED)  &&  (!defined(OWB_INT_USE_COMP)  ||  !defined(OWB_CALIBRATION_ENABLED))
+#error OWB_COMP_CHARACTERIZATION_ENABLED needs OWB_INT_USE_COMP and OWB_CALIBRATION_ENABLED
+#endif
+
+// Number of a port for comparisons in #if, where the port registers themselves would all be 0. The device header
+// defines PA as _pa, but accept both in case it isn't included yet.
+#define OWBPortID(px)       OWBPortIDStr(px)
+#define OWBPortIDStr(px)    OWB_PORT_ID_ ## px
+#define OWB_PORT_ID_PA      1
+#define OWB_PORT_ID__pa     1
+#define OWB_PORT_ID_PB      2
+#define OWB_PORT_ID__pb     2
+
+#if defined(OWB_DEBUG_ENABLED)  &&  OWBPortID(DBG_Px) == OWBPortID(OWB_Px)  &&  DBG_PIN == OWB_PIN
+#error The debug pin of OWB_DEBUG_ENABLED must not be the OWB pin, move one of them (DBG_PIN, OWB_PIN)
+#endif
+#if defined(OWB_DEBUG_ENABLED)  &&  defined(OWB_SECOND_BUS_ENABLED)
+#if OWBPortID(DBG_Px) == OWBPortID(OWB_BUS1_Px)  &&  DBG_PIN == OWB_BUS1_PIN
+#error The debug pin of OWB_DEBUG_ENABLED must not be the pin of bus 1, move one of them (DBG_PIN, OWB_BUS1_PIN)
+#endif
+#endif
+#if defined(OWB_CALIBRATION_LEARN_MASTER)  &&  !defined(OWB_CALIBRATION_ENABLED)
+#error OWB_CALIBRATION_LEARN_MASTER needs the timing tables of OWB_CALIBRATION_ENABLED
 #endif
 
 // Convert microseconds to T16 tick values, optionally adjusting for interrupt latency
@@ -66,7 +252,56 @@
 #define OWB_TIMING_RST_1        OWB_TIMING_US_TO_TICKS_WITH_LATENCY(15)
 #define OWB_TIMING_RST_PP       OWB_TIMING_US_TO_TICKS_WITH_LATENCY(150)
 
-#define OWB_TIMING_LOW_TO_ISR_LATENCY_TICKS     8
+// Same as above, but for overdrive speed
+#define OWB_TIMING_OD_W1_0_MIN  OWB_TIMING_US_TO_TICKS_WITH_LATENCY(0)
+#define OWB_TIMING_OD_W0_0_MIN  OWB_TIMING_US_TO_TICKS_WITH_LATENCY(4)
+#define OWB_TIMING_OD_R0_0      OWB_TIMING_US_TO_TICKS_WITH_LATENCY(4)
+#define OWB_TIMING_OD_RST_0_MIN OWB_TIMING_US_TO_TICKS_WITH_LATENCY(30)
+#define OWB_TIMING_OD_RST_1     OWB_TIMING_US_TO_TICKS_WITH_LATENCY(3)
+#define OWB_TIMING_OD_RST_PP    OWB_TIMING_US_TO_TICKS_WITH_LATENCY(12)
+
+// Ticks from the start of a falling edge until it crosses the comparator's reference, assuming that it falls linearly
+// over OWB_BUS_FALL_TIME_NS
+#ifdef OWB_INT_USE_COMP
+#define OWB_COMP_EDGE_DELAY_TICKS                                                                   \
+        ((OWB_BUS_FALL_TIME_NS * (1000ul - OWB_COMP_THRESHOLD_PERMILLE) / 1000 * (F_CPU/1000000) + 999) / 1000)
+#else
+#define OWB_COMP_EDGE_DELAY_TICKS               0
+#endif
+
+// Ticks from the falling edge (or the crossing of the comparator's reference) until T16 starts. Must be a plain number,
+// since the ISR exports it for tools/owb_isr_cycles.py, which adds OWB_COMP_EDGE_DELAY_TICKS itself.
+#ifdef OWB_POLLING_MODE
+#define OWB_TIMING_LOW_TO_ISR_LATENCY_BASE_TICKS    3
+#else
+#define OWB_TIMING_LOW_TO_ISR_LATENCY_BASE_TICKS    8
+#endif
+#define OWB_TIMING_LOW_TO_ISR_LATENCY_TICKS     (OWB_TIMING_LOW_TO_ISR_LATENCY_BASE_TICKS + OWB_COMP_EDGE_DELAY_TICKS)
+
+// Number of LOW pulses measured by OWBCalibrate(), and the ticks from ISR entry to the start of T16, which the
+// measurement can't see (compare with the "Edge to T16 start" result of tools/owb_isr_cycles.py).
+#define OWB_CALIBRATION_RUNS                    4
+// Ticks after which a single measurement of OWBCalibrate() gives up (the T16 interrupt bit), e.g. if the comparator's
+// reference is above the level the bus recovers to
+#define OWB_CALIBRATION_TIMEOUT_TICKS           (1u << OWB_T16_INT_BIT)
+#ifdef OWB_POLLING_MODE
+#define OWB_CALIBRATION_ISR_ENTRY_TICKS         0
+#else
+#define OWB_CALIBRATION_ISR_ENTRY_TICKS         2
+#endif
+
+// Ticks from a falling edge until the core runs again after stopexe with OWB_IDLE_ENABLED. This value isn't measured,
+// just a conservative guess, which OWB_CALIBRATION_ENABLED replaces with a measurement. The budget
+// is how much later than usual the ISR may start, and still see the shortest RST of the master (480us, 48us for
+// overdrive) as such.
+#define OWB_IDLE_WAKEUP_TICKS                   16
+// Ticks after which T16 wakes up the core when OWBCalibrate() measures the above
+#define OWB_CALIBRATION_IDLE_TIMEOUT_TICKS      32
+#ifdef OWB_OVERDRIVE_ENABLED
+#define OWB_IDLE_WAKEUP_BUDGET_TICKS            (OWB_TIMING_US_TO_TICKS_WITH_LATENCY(48) - OWB_TIMING_OD_RST_0_MIN)
+#else
+#define OWB_IDLE_WAKEUP_BUDGET_TICKS            (OWB_TIMING_US_TO_TICKS_WITH_LATENCY(480) - OWB_TIMING_RST_0_MIN)
+#endif
 
 
 enum OWBState
@@ -74,7 +309,15 @@ enum OWBState
     OWB_STATE_IDLE,
     OWB_STATE_RESET,
     OWB_STATE_READ_ROM,
-    OWB_STATE_SEARCH_ROM
+    OWB_STATE_SEARCH_ROM,
+    OWB_STATE_MATCH_ROM,
+    OWB_STATE_FUNCTION,
+    OWB_STATE_FUNCTION_COMMAND,
+    OWB_STATE_WRITE_SCRATCHPAD,
+    OWB_STATE_READ_SCRATCHPAD,
+    OWB_STATE_READ_STATS,
+    OWB_STATE_READ_COMP_LATENCY,
+    OWB_STATE_READ_CRC8
 };
 
 // IMPORTANT: This value must be 16-bit aligned because it's used by the ldt16 instruction. The most reliable way to
@@ -91,11 +334,212 @@ extern volatile uint16_t T16Value;
 #define DbgPulse()
 #endif
 
+#ifdef OWB_DEBUG_TRACE
+// Events of the trace, with the number of pulses that identify them. READ0 is the single pulse of DbgPulse(), so it
+// looks the same as without OWB_DEBUG_TRACE. Keep tools/sigrok/owb_trace/pd.py in sync with these.
+#define OWB_DBG_EVENT_READ0         1   // Bus pulled low for READ0
+#define OWB_DBG_EVENT_ISR_ENTRY     2   // T16 started at ISR entry
+#define OWB_DBG_EVENT_WRITE1        3   // LOW pulse recognized as WRITE1
+#define OWB_DBG_EVENT_WRITE0        4   // LOW pulse recognized as WRITE0 (or the start of a RST)
+#define OWB_DBG_EVENT_RESET         5   // RST recognized
+#define OWB_DBG_EVENT_STATE         6   // High-level state changed during this interrupt
+
+// Emit an event as a burst of pulses on the debug pin, each 1 cycle HIGH and 1 cycle LOW, followed by at least one
+// more cycle LOW to separate it from the next event. Costs exactly 2 * id + 1 cycles, and needs a logic analyzer
+// sampling at no less than 3 times F_CPU.
+#define DbgEvent(id)                DbgEventPulses(id)
+#define DbgEventPulses(n)                       \
+        do {                                    \
+            DbgEventPulses ## n();              \
+            __asm__("nop\n");                   \
+        } while (false)
+#define DbgEventPulse()             DBG_Px |= (1 << DBG_PIN); DBG_Px &= ~(1 << DBG_PIN)
+#define DbgEventPulses1()           DbgEventPulse()
+#define DbgEventPulses2()           DbgEventPulses1(); DbgEventPulse()
+#define DbgEventPulses3()           DbgEventPulses2(); DbgEventPulse()
+#define DbgEventPulses4()           DbgEventPulses3(); DbgEventPulse()
+#define DbgEventPulses5()           DbgEventPulses4(); DbgEventPulse()
+#define DbgEventPulses6()           DbgEventPulses5(); DbgEventPulse()
+#else
+#define DbgEvent(id)
+#endif
+
+// Define a global symbol for the current code location without emitting any instructions. These markers are used by
+// external tools (e.g. tools/owb_ucsim_bench.py) to find interesting points inside the ISR. We use an assignment
+// instead of a label, because a label would break the scope of the local labels generated by SDCC.
+#define OWBMark(name) __asm__("_OWBMark" #name " == .\n")
+
+// Define a global symbol with the value of a configuration constant, so that external tools (e.g.
+// tools/owb_isr_cycles.py) can check it against the generated code. The value must expand to a plain number.
+#define OWBExportValue(name, value)     OWBExportValueStr(name, value)
+#define OWBExportValueStr(name, value)  __asm__("_OWB" #name " == " #value "\n")
+
 
 
 void OWBInit(void);
 
 
 void OWBReset(void);
+void OWBBusFault(void);
 void OWBWriteBit(void);
 void OWBReadBit(void);
+
+#ifdef OWB_POLLING_MODE
+void OWBPollingLoop(void);
+#endif
+
+#ifdef OWB_VIRTUAL_SLAVES_ENABLED
+#include "owb_virtual_rom_codes.h"
+
+// There's nothing to copy to RAM, the ROM codes are compiled into a table
+#undef OWB_ROM_CODE_IN_RAM
+
+// Mask of the virtual slaves (bit i for the i-th ROM code) selected by the last ROM command. Set by the ISR right
+// before the function command starts, so the main loop should fetch it when OWBFIFONewTransaction() returns true.
+extern volatile uint8_t OWBSelectedSlaves;
+#endif
+
+#ifdef OWB_ALARM_SEARCH_ENABLED
+// Non-zero while the slave responds to ALARM SEARCH. The ISR only reads it once when ALARM SEARCH starts, and single
+// byte writes are atomic, so the application may set or clear it at any time without disabling interrupts. With
+// OWB_POLLING_MODE, it can only be set before entering the polling loop.
+extern volatile uint8_t OWBAlarmFlag;
+
+// Set or clear the alarm of all virtual slaves. Setting or clearing a single bit of OWBAlarmFlag compiles to set1/set0,
+// which is just as atomic.
+#define OWBSetAlarm()       OWBAlarmFlag = 0xFF
+#define OWBClearAlarm()     OWBAlarmFlag = 0
+#endif
+
+#ifdef OWB_SCRATCHPAD_ENABLED
+// Scratchpad for WRITE SCRATCHPAD and READ SCRATCHPAD, defined by the application. The ISR accesses it at any time
+// while the slave is selected.
+extern uint8_t OWBScratchpad[OWB_SCRATCHPAD_SIZE];
+
+// Set to 1 by the ISR upon COPY SCRATCHPAD. The main loop should copy the scratchpad wherever it belongs, and then
+// clear this again. Nobody handles it with OWB_POLLING_MODE.
+extern volatile uint8_t OWBScratchpadCopyRequest;
+#endif
+
+#ifdef OWB_CRC_ENABLED
+// Update a CRC with a single bit. CRC8 is the Dallas/Maxim CRC (x^8 + x^5 + x^4 + 1) and CRC16 is the one used by
+// e.g. the DS2431 (x^16 + x^15 + x^2 + 1), both LSB first with an initial value of 0.
+#define OWBCRC8Bit(crc, bit)    (crc) = (((crc) ^ (bit)) & 0x01) ? (((crc) >> 1) ^ 0x8C) : ((crc) >> 1)
+#define OWBCRC16Bit(crc, bit)   (crc) = (((crc) ^ (bit)) & 0x01) ? (((crc) >> 1) ^ 0xA001) : ((crc) >> 1)
+
+// Both are reset when the slave is selected, and CRC8 additionally when READ SCRATCHPAD starts. While the master is
+// reading, they already include the bit prepared for the next READ.
+extern volatile uint8_t OWBCRC8;
+extern volatile uint16_t OWBCRC16;
+
+// Fetch OWBCRC16 for the main loop, e.g. to queue its complement with OWBFIFOTxPut() once the master has written all
+// bytes that it covers. It keeps running with every following bit, including the ones of the CRC itself.
+uint16_t OWBCRC16Get(void);
+#endif
+
+#ifdef OWB_STATS_ENABLED
+// Number of bins of the WRITE histogram, and the T16 ticks covered by each (4us, independent of F_CPU)
+#define OWB_STATS_HISTOGRAM_BINS    8
+#if F_CPU >= 8000000
+#define OWB_STATS_HISTOGRAM_SHIFT   5
+#elif F_CPU >= 4000000
+#define OWB_STATS_HISTOGRAM_SHIFT   4
+#elif F_CPU >= 2000000
+#define OWB_STATS_HISTOGRAM_SHIFT   3
+#else
+#define OWB_STATS_HISTOGRAM_SHIFT   2
+#endif
+
+// Statistics about the bus, in the order that OWB_STATS_COMMAND sends them (multi-byte values LSB first). All counters
+// wrap around, so the master should look at the difference between two reads. With OWB_SECOND_BUS_ENABLED, they
+// count both buses.
+struct OWBStats
+{
+    // RSTs recognized, and presence pulses sent in response (fewer if the bus got stuck LOW)
+    uint16_t Resets;
+    uint16_t PresencePulses;
+
+    // LOW pulses ignored as too short for a WRITE1 with OWB_SKIP_SHORT_PULSES
+    uint16_t ShortPulses;
+
+    // Slots of SEARCH ROM (or ALARM SEARCH) where the master chose the other branch, and the slave dropped out
+    uint16_t SearchROMMismatches;
+
+    // READ0s where the bus was already HIGH again when the slave wanted to pull it low, i.e. the master's LOW pulse was
+    // too short for the slave to extend it. With OWB_SKIP_SHORT_PULSES, these READ0s are skipped, otherwise they
+    // are still sent (and will probably be read as 1). Only 8 bits, because it's counted with a single instruction
+    // right before pulling the bus low (see OWB_STATS_READ0_LATE_OFFSET). Not counted with OWB_SECOND_BUS_ENABLED.
+    uint8_t Read0Late;
+
+    // T16 at the time the ISR decided between WRITE1 and WRITE0 (and glitch, with OWB_SKIP_SHORT_PULSES), for every LOW
+    // pulse in write-mode. Bin i counts values of (i << OWB_STATS_HISTOGRAM_SHIFT) up to the next bin, the last one
+    // counts everything from there on, which includes all WRITE0s (and RSTs, which look like WRITE0 at that time).
+    // When a bin would overflow, all bins are halved, so they keep their proportions.
+    uint8_t WriteHistogram[OWB_STATS_HISTOGRAM_BINS];
+};
+
+extern volatile struct OWBStats OWBStats;
+
+// Offset of Read0Late in OWBStats (for the ISR's assembly), and the number of bytes sent by OWB_STATS_COMMAND. There's
+// no padding in between, all 16 bit counters come first.
+#define OWB_STATS_READ0_LATE_OFFSET 8
+#define OWB_STATS_SIZE              (OWB_STATS_READ0_LATE_OFFSET + 1 + OWB_STATS_HISTOGRAM_BINS)
+#endif
+
+#ifdef OWB_COMP_CHARACTERIZATION_ENABLED
+// Number of comparator levels in a GPCS range
+#define OWB_COMP_LEVELS             16
+
+// Latency in T16 ticks (including OWB_CALIBRATION_ISR_ENTRY_TICKS) per comparator level of OWB_COMP_RANGE, as measured
+// by OWBCalibrate(), or 0xFF if the edge wasn't seen within OWB_CALIBRATION_TIMEOUT_TICKS
+extern uint8_t OWBCompLatency[OWB_COMP_LEVELS];
+#endif
+
+#ifdef OWB_CALIBRATION_ENABLED
+// Measure the edge-to-ISR latency and derive the timing thresholds from it (and fill OWBCompLatency first with
+// OWB_COMP_CHARACTERIZATION_ENABLED). Must be called after enabling the digital input of the OWB pin (PADIER), and
+// before enabling interrupts.
+void OWBCalibrate(void);
+#endif
+
+#ifdef OWB_IDLE_ENABLED
+// Stop the core until the next edge on the bus if the slave has nothing to do, or return right away. Call this at the
+// end of every main loop iteration, once the main loop has nothing left to do either.
+void OWBIdle(void);
+#endif
+
+
+#ifdef OWB_FIFO_ENABLED
+#if (OWB_FIFO_SIZE & (OWB_FIFO_SIZE-1)) != 0  ||  OWB_FIFO_SIZE > 128
+#error OWB_FIFO_SIZE must be a power of 2, and at most 128
+#endif
+
+// Each FIFO has exactly one producer and one consumer, each of which is the only one writing its own index. The
+// indices are free-running and only masked when accessing the buffer, so a FIFO is full when they are OWB_FIFO_SIZE
+// apart. This needs no locking, because reading or writing a single byte is atomic.
+
+// Bytes written by the master. Producer is the ISR, consumer is the main loop.
+extern volatile uint8_t OWBFIFORx[OWB_FIFO_SIZE];
+extern volatile uint8_t OWBFIFORxHead;
+extern volatile uint8_t OWBFIFORxTail;
+
+// Bytes to be read by the master. Producer is the main loop, consumer is the ISR.
+extern volatile uint8_t OWBFIFOTx[OWB_FIFO_SIZE];
+extern volatile uint8_t OWBFIFOTxHead;
+extern volatile uint8_t OWBFIFOTxTail;
+
+#define OWBFIFORxAvailable()    (OWBFIFORxHead != OWBFIFORxTail)
+#define OWBFIFOTxFull()         ((uint8_t) (OWBFIFOTxHead - OWBFIFOTxTail) == OWB_FIFO_SIZE)
+
+// Returns true (once) if the slave was selected by a ROM command since the last call. Any bytes still left over from
+// the previous function command are dropped from the RX FIFO, so that the next byte returned by OWBFIFORxGet() is the
+// first byte of the new function command. Pending bytes in the TX FIFO are dropped by the ISR upon selection.
+bool OWBFIFONewTransaction(void);
+
+// Fetch the next received byte. Only call this if OWBFIFORxAvailable().
+uint8_t OWBFIFORxGet(void);
+
+// Queue a byte to be read by the master. Returns false if the TX FIFO is full. If the slave is currently waiting for
+// the master to write, it is switched to read-mode, so queue responses only when the master expects them.
+bool OWBFIFOTxPut(uint8_t b);
+#endif
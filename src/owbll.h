@@ -23,19 +23,118 @@
 //  then never change it afterwards? Without it, the bus will sometimes not be pulled low, specifically when
 //  OWB_INT_USE_COMP is enabled.
 // Direct bus manipulation
+#ifdef OWB_SECOND_BUS_ENABLED
+// Set if the state of bus 1 is the current one (see OWBLLSwitchBus())
+#define OWBLLOnBus1()       (OWBLLStateFlags & OWB_STATE_FLAG_BUS1)
+
+#define OWBLLSetInput()                                 \
+        do {                                            \
+            if (OWBLLOnBus1()) {                        \
+                OWB_BUS1_PxC &= ~(1 << OWB_BUS1_PIN);   \
+            } else {                                    \
+                OWB_PxC &= ~(1 << OWB_PIN);             \
+            }                                           \
+        } while (false)
+#define OWBLLSetLow()                                   \
+        do {                                            \
+            if (OWBLLOnBus1()) {                        \
+                OWB_BUS1_PxC |= (1 << OWB_BUS1_PIN);    \
+                OWB_BUS1_Px &= ~(1 << OWB_BUS1_PIN);    \
+            } else {                                    \
+                OWB_PxC |= (1 << OWB_PIN);              \
+                OWB_Px &= ~(1 << OWB_PIN);              \
+            }                                           \
+        } while (false)
+#define OWBLLGetValue()                                 \
+        (OWBLLOnBus1() ? (OWB_BUS1_Px & (1 << OWB_BUS1_PIN)) : (OWB_Px & (1 << OWB_PIN)))
+#else
 #define OWBLLSetInput()     OWB_PxC &= ~(1 << OWB_PIN)
 #define OWBLLSetLow()                   \
         OWB_PxC |= (1 << OWB_PIN);      \
         OWB_Px &= ~(1 << OWB_PIN)
 #define OWBLLGetValue()     (OWB_Px & (1 << OWB_PIN))
+#endif
 
 // The IRQ flag used for detecting LOW pulses on the bus
-#ifdef OWB_INT_USE_COMP
+#ifdef OWB_SECOND_BUS_ENABLED
+// Bus 0 uses the pin interrupt, bus 1 the comparator
+#define OWB_LOW_DETECT_IRQ_FLAG     (OWBLLOnBus1() ? INTRQ_COMP : INTRQ_PA0)
+#elif defined(OWB_INT_USE_COMP)
 #define OWB_LOW_DETECT_IRQ_FLAG     INTRQ_COMP
+#define OWB_LOW_DETECT_IRQ_BIT      INTRQ_COMP_BIT
 #else
 #define OWB_LOW_DETECT_IRQ_FLAG     INTRQ_PA0
+#define OWB_LOW_DETECT_IRQ_BIT      INTRQ_PA0_BIT
 #endif
 
+// Select the edge of the OWB pin that triggers the interrupt. The falling edge is used for detecting LOW pulses, the
+// rising edge only for detecting the end of a RST.
+// IMPORTANT: INTEGS and MISC2 are WRITE-ONLY registers, so set them up in one go.
+#ifdef OWB_SECOND_BUS_ENABLED
+// Only the current bus ever waits for a rising edge. The other one always stays on the falling edge.
+#define OWB_LOW_DETECT_INT_ENABLE   (OWBLLOnBus1() ? INTEN_COMP : INTEN_PA0)
+#ifdef INTEGS_COMP_FALLING
+#define OWBLLIntOnFalling()     INTEGS = INTEGS_PA0_FALLING | INTEGS_COMP_FALLING
+#define OWBLLIntOnRising()                                                              \
+        INTEGS = OWBLLOnBus1() ? (INTEGS_PA0_FALLING | INTEGS_COMP_RISING) : (INTEGS_PA0_RISING | INTEGS_COMP_FALLING)
+#elif defined(MISC2_COMP_EDGE_INT_FALL)
+#define OWBLLIntOnFalling()     INTEGS = INTEGS_PA0_FALLING; MISC2 = MISC2_COMP_EDGE_INT_FALL
+#define OWBLLIntOnRising()                                  \
+        do {                                                \
+            if (OWBLLOnBus1()) {                            \
+                INTEGS = INTEGS_PA0_FALLING;                \
+                MISC2 = MISC2_COMP_EDGE_INT_RISE;           \
+            } else {                                        \
+                INTEGS = INTEGS_PA0_RISING;                 \
+                MISC2 = MISC2_COMP_EDGE_INT_FALL;           \
+            }                                               \
+        } while (false)
+#else
+#error Unable to select falling edge as COMP interrupt condition. Neither INTEGS nor MISC2 is supported.
+#endif
+#elif defined(OWB_INT_USE_COMP)
+#define OWB_LOW_DETECT_INT_ENABLE   INTEN_COMP
+// The comparator output is inverted, but the edge selection for COMP refers to the pin.
+#ifdef INTEGS_COMP_FALLING
+#define OWBLLIntOnFalling()     INTEGS = INTEGS_COMP_FALLING
+#define OWBLLIntOnRising()      INTEGS = INTEGS_COMP_RISING
+#elif defined(MISC2_COMP_EDGE_INT_FALL)
+#define OWBLLIntOnFalling()     INTEGS = 0; MISC2 = MISC2_COMP_EDGE_INT_FALL
+#define OWBLLIntOnRising()      INTEGS = 0; MISC2 = MISC2_COMP_EDGE_INT_RISE
+#else
+#error Unable to select falling edge as COMP interrupt condition. Neither INTEGS nor MISC2 is supported.
+#endif
+#else
+#define OWB_LOW_DETECT_INT_ENABLE   INTEN_PA0
+#define OWBLLIntOnFalling()     INTEGS = INTEGS_PA0_FALLING
+#define OWBLLIntOnRising()      INTEGS = INTEGS_PA0_RISING
+#endif
+
+#if defined(OWB_INT_USE_COMP)  ||  defined(OWB_SECOND_BUS_ENABLED)
+// Select the comparator's reference within OWB_COMP_RANGE. GPCS is WRITE-ONLY, so it's always set up in one go.
+#define OWBLLSetCompLevel(level)    GPCS = OWB_COMP_RANGE | ((level) << GPCS_COMP_VOLTAGE_LVL_BIT0)
+#endif
+
+// Interrupts enabled while no RST is in progress, i.e. while waiting for the falling edge of the next slot
+#ifdef OWB_SECOND_BUS_ENABLED
+#define OWB_IDLE_INT_ENABLE         (INTEN_PA0 | INTEN_COMP)
+#else
+#define OWB_IDLE_INT_ENABLE         OWB_LOW_DETECT_INT_ENABLE
+#endif
+
+// T16 raises its interrupt when bit OWB_T16_INT_BIT of T16C goes HIGH. OWBLLStartT16Timeout() presets T16C so that
+// this happens after the given number of ticks, which must be less than (1 << OWB_T16_INT_BIT).
+#define OWB_T16_INT_BIT             11
+#define OWB_T16_INT_SRC             T16M_INTSRC_11BIT
+#define OWBLLStartT16Timeout(ticks) T16C = ((1u << OWB_T16_INT_BIT) - 1) - (ticks)
+
+// While waiting for the end of a RST, T16 keeps counting from the falling edge, and its interrupt is moved to bit
+// OWB_T16_FAULT_INT_BIT instead. If the bus is still LOW when that bit goes HIGH (8192 ticks, i.e. 1ms at 8MHz and
+// 2ms at 4MHz, far longer than any valid RST), the bus is considered faulty (e.g. shorted to GND).
+#define OWB_T16_FAULT_INT_BIT       13
+#define OWB_T16_FAULT_INT_SRC       T16M_INTSRC_13BIT
+#define OWBLLSetT16IntSrc(src)      T16M = T16M_CLK_SYSCLK | T16M_CLK_DIV1 | (src)
+
 // Fetch the bit for the next READ operation. Be careful with OWBLLNextRead0INTRQFlag (see its definition).
 #define OWBLLSetupNextRead()                                        \
         do {                                                        \
@@ -61,6 +160,11 @@
 //  for changing to write-mode within OWBReadBit(), which is called ahead of the actual READ operation it applies to.
 #define OWBLLSwitchToWrite()    OWBLLStateFlags |= OWB_STATE_FLAG_DELAYED_SWITCH_TO_WRITE
 
+// Make the driver switch to overdrive speed. Like OWBLLSwitchToWrite(), this does NOT immediately take effect, but only
+// after the current 1-Wire operation is complete. Otherwise, the W0 that finishes an overdrive ROM command would be
+// measured against the overdrive timing and mistaken for a RST.
+#define OWBLLSwitchToOverdrive()    OWBLLStateFlags |= OWB_STATE_FLAG_DELAYED_SWITCH_TO_OVERDRIVE
+
 // Make the driver switch to write-mode IMMEDIATELY, without waiting to complete any buffered READ bits.
 #define OWBLLSwitchToWriteImmediately()                             \
         OWBLLNextRead0INTRQFlag = 0;                                \
@@ -69,9 +173,34 @@
 
 // SDCC currently doesn't support reading T16C from C, so we have to use ASM. The destination also MUST be
 // 16-bit aligned, which doesn't reliably work with temporaries.
+#ifdef __SDCC
 #define OWBLLGetT16Value() __asm__("ldt16 _T16Value\n")
+#else
+// Host build (see host/), where T16C is just a variable of the mock device header
+#define OWBLLGetT16Value() T16Value = T16C
+#endif
 #define OWBLLWaitForT16(minValue) do { OWBLLGetT16Value(); } while (T16Value < (minValue))
 
+// Select the value of one of the OWB_TIMING_* constants (without prefix) for the current bus speed. OWB_TIMING_STD()
+// always selects the value for standard speed. With OWB_CALIBRATION_ENABLED, the values come from RAM instead.
+#ifdef OWB_CALIBRATION_ENABLED
+#ifdef OWB_OVERDRIVE_ENABLED
+#define OWB_TIMING(name)                                                                \
+        ((OWBLLStateFlags & OWB_STATE_FLAG_OVERDRIVE) ? OWBLLTimingOD.name : OWBLLTimingStd.name)
+#else
+#define OWB_TIMING(name)    OWBLLTimingStd.name
+#endif
+#define OWB_TIMING_STD(name)    OWBLLTimingStd.name
+#else
+#ifdef OWB_OVERDRIVE_ENABLED
+#define OWB_TIMING(name)                                                                \
+        ((OWBLLStateFlags & OWB_STATE_FLAG_OVERDRIVE) ? OWB_TIMING_OD_##name : OWB_TIMING_##name)
+#else
+#define OWB_TIMING(name)    OWB_TIMING_##name
+#endif
+#define OWB_TIMING_STD(name)    OWB_TIMING_##name
+#endif
+
 // To be used inside OWBWriteBit() to distinguish between WRITE0 and WRITE1
 #define OWBLLGetWriteValue()            OWBLLCurrentBitValue
 
@@ -81,16 +210,41 @@
 
 enum
 {
+    OWB_STATE_FLAG_OVERDRIVE                = 0x01,
     OWB_STATE_FLAG_SEARCH_ROM_INVERT        = 0x02,
+    OWB_STATE_FLAG_OVERDRIVE_PENDING        = 0x04,
+    OWB_STATE_FLAG_DELAYED_SWITCH_TO_OVERDRIVE = 0x08,
 
     OWB_STATE_FLAG_NEXT_IS_READ             = 0x10,
     OWB_STATE_FLAG_MIGHT_BE_RST             = 0x20,
-    OWB_STATE_FLAG_TIMER_OVERFLOW           = 0x40,
+    OWB_STATE_FLAG_BUS1                     = 0x40,
     OWB_STATE_FLAG_DELAYED_SWITCH_TO_WRITE  = 0x80
 };
 
 
 
+// Phases of a RST after its LOW pulse was recognized. These are driven by interrupts (see OWBLLResetStep()), so that
+// the ISR doesn't block the main loop for the rest of the RST.
+enum
+{
+    OWB_RESET_PHASE_NONE,
+
+    // Waiting for the end of the master's LOW pulse (rising edge interrupt)
+    OWB_RESET_PHASE_WAIT_IDLE,
+
+    // Leaving the bus idle before the presence pulse (T16 interrupt)
+    OWB_RESET_PHASE_IDLE,
+
+    // Sending the presence pulse (T16 interrupt)
+    OWB_RESET_PHASE_PRESENCE,
+
+    // The bus was LOW for too long. Waiting for it to come back (rising edge interrupt), without sending a presence
+    // pulse afterwards.
+    OWB_RESET_PHASE_BUS_FAULT
+};
+
+
+
 // Miscellaneous state related flags used by both the low-level and high-level driver
 extern volatile uint8_t OWBLLStateFlags;
 
@@ -101,3 +255,70 @@ extern volatile uint8_t OWBLLNextRead0INTRQFlag;
 
 // Bit value of the current/next READ/WRITE operation
 extern volatile uint8_t OWBLLCurrentBitValue;
+
+// Current OWB_RESET_PHASE_*
+extern volatile uint8_t OWBLLResetPhase;
+
+
+// Advance the RST phase after its interrupt. Must only be called from the ISR while OWBLLResetPhase is not
+// OWB_RESET_PHASE_NONE.
+void OWBLLResetStep(void);
+
+#ifdef OWB_SECOND_BUS_ENABLED
+// Exchange the state of the current bus with that of the other bus. Must only be called from the ISR while
+// OWBLLResetPhase is OWB_RESET_PHASE_NONE.
+void OWBLLSwitchBus(void);
+#endif
+
+
+#ifdef OWB_DEBUG_TRACE
+// High-level state from owb.c, and its value when the ISR last emitted OWB_DBG_EVENT_STATE
+extern uint8_t CurrentState;
+extern uint8_t OWBLLDbgState;
+#endif
+
+#ifdef OWB_STATS_ENABLED
+// Histogram bin of the last WRITE decision plus 1, or 0 if there is none to record. Set by the ISR before the p
+// register is saved, so it must not index any arrays there yet.
+extern uint8_t OWBLLStatsWriteBin;
+
+// Called by the ISR once it's safe to use the p register, to add OWBLLStatsWriteBin to the histogram of OWBStats
+void OWBLLStatsRecordWrite(void);
+
+// Remember T16Value for the histogram of WRITE decisions
+#define OWBLLStatsWriteDecided()    OWBLLStatsWriteBin = ((uint8_t) T16Value >> OWB_STATS_HISTOGRAM_SHIFT) + 1
+#endif
+
+
+#ifdef OWB_CALIBRATION_ENABLED
+// List of all slot timing thresholds as X(name), where name is the OWB_TIMING_* constant without prefix
+#define OWB_TIMING_NAMES(X)     X(W1_0_MIN) X(W0_0_MIN) X(R0_0) X(RST_0_MIN) X(RST_1) X(RST_PP)
+
+#define OWB_TIMING_TABLE_ENTRY(name)    uint16_t name;
+
+// Timing thresholds in T16 ticks, with the measured latency subtracted
+struct OWBLLTimingTable
+{
+    OWB_TIMING_NAMES(OWB_TIMING_TABLE_ENTRY)
+#ifdef OWB_CALIBRATION_LEARN_MASTER
+    // Longest WRITE1 LOW pulse of the master seen so far (as measured by T16), or 0
+    uint16_t MASTER_W1;
+#endif
+};
+
+extern struct OWBLLTimingTable OWBLLTimingStd;
+#ifdef OWB_OVERDRIVE_ENABLED
+extern struct OWBLLTimingTable OWBLLTimingOD;
+#endif
+
+// Measured latency from the falling edge to the start of T16 in the ISR
+extern uint8_t OWBLLLatencyTicks;
+
+// Fill the timing tables from the OWB_TIMING_* constants and OWBLLLatencyTicks
+void OWBLLLoadTiming(void);
+
+#ifdef OWB_CALIBRATION_LEARN_MASTER
+// Called by the ISR for every WRITE1, with its LOW pulse length in T16Value
+void OWBLLLearnW1(void);
+#endif
+#endif
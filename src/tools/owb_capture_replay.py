@@ -0,0 +1,383 @@
+#!/usr/bin/env python3
+
+# pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+# Copyright (C) 2024 David "Alemarius Nexus" Lerch
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Replay a logic analyzer capture of a 1-Wire bus against the host build of the firmware.
+
+The capture (VCD, or a sigrok session file .sr) is converted into a stream for owb_replay (see src/host), with one raw
+LOW pulse token per master slot, P=<ticks>:<result>. The ticks are the master's LOW time at the host model's F_CPU, and
+the result is what the slave in the capture answered with:
+
+    L   The bus was LOW at the master's sample time, i.e. the slave extended the pulse for a READ0. If the master's
+        pulse was so short that the bus went HIGH before the slave pulled it low (the short READ pulses mentioned in
+        interrupt.c), the separate slave pulse is also counted as an answer to the preceding slot.
+    P   A presence pulse followed a RESET.
+    -   Neither.
+
+Whether a LOW pulse was extended by the slave can't be told from a single bus line, so pulses longer than the sample
+time but no longer than --read0-max-us are taken as READ0. The speed is switched to overdrive after OVERDRIVE SKIP ROM
+and OVERDRIVE MATCH ROM, and back to standard after a standard RESET.
+
+The ROM code of the slave is taken from the first READ ROM or MATCH ROM in the capture, unless given with --rom. The
+capture should only contain the slave under test, since the answers of several slaves can't be told apart. Pulses
+before the first RESET are skipped, because the slave's state there is unknown. The time between slots isn't part of
+the stream, because the host model only looks at the LOW pulses.
+
+With --replay, the stream is run through owb_replay right away, and every mismatch is reported with its time in the
+capture. The stream can also be written with --output and added to src/host/streams as a regression test. Like the
+streams there, it names the ROM commands that can be left out of the firmware in a "# Uses:" line. A replay of a
+capture that uses one of the commands given with --disabled is skipped, as the host build does for such streams.
+"""
+
+import argparse
+import configparser
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import zipfile
+
+
+# Master timing per speed in microseconds: Sample time, longest slave READ0, latest start of the presence pulse after
+# the end of a RESET, and shortest RESET
+TIMING = {
+    "std": {"sample": 15.0, "read0_max": 45.0, "presence_start": 75.0, "rst_min": 240.0},
+    "od": {"sample": 2.0, "read0_max": 6.0, "presence_start": 10.0, "rst_min": 48.0},
+}
+
+ROM_CMD_READ = 0x33
+ROM_CMD_MATCH = 0x55
+ROM_CMD_OVERDRIVE_SKIP = 0x3C
+ROM_CMD_OVERDRIVE_MATCH = 0x69
+
+# ROM commands that can be left out with OWB_<name>_DISABLED
+OPTIONAL_ROM_CMDS = {0x33: "READ_ROM", 0xF0: "SEARCH_ROM", 0xA5: "RESUME"}
+
+UNITS = {"": 1.0, "k": 1e3, "m": 1e6, "g": 1e9}
+TIMESCALE_US = {"s": 1e6, "ms": 1e3, "us": 1.0, "ns": 1e-3, "ps": 1e-6, "fs": 1e-9}
+
+
+class CaptureError(Exception):
+    pass
+
+
+def select_channel(names, channel):
+    if channel is not None:
+        if channel in names:
+            return channel
+        if channel.isdigit() and int(channel) < len(names):
+            return names[int(channel)]
+        raise CaptureError("channel %s not found, available: %s" % (channel, ", ".join(names)))
+    if len(names) == 1:
+        return names[0]
+    matches = [n for n in names if re.search(r"1.?wire|owb|onewire|dq", n, re.IGNORECASE)]
+    if len(matches) != 1:
+        raise CaptureError("use --channel to select one of: %s" % ", ".join(names))
+    return matches[0]
+
+
+def read_vcd(path, channel):
+    """Returns the edges of the selected signal as (time in us, level) tuples."""
+    with open(path) as f:
+        tokens = f.read().split()
+
+    scale = 1.0
+    ids = {}
+    i = 0
+    while i < len(tokens) and tokens[i] != "$enddefinitions":
+        if tokens[i] == "$timescale":
+            spec = ""
+            i += 1
+            while tokens[i] != "$end":
+                spec += tokens[i]
+                i += 1
+            m = re.match(r"(\d+)([a-z]+)$", spec)
+            if not m or m.group(2) not in TIMESCALE_US:
+                raise CaptureError("invalid timescale %s" % spec)
+            scale = int(m.group(1)) * TIMESCALE_US[m.group(2)]
+        elif tokens[i] == "$var":
+            # $var <type> <width> <id> <name> [<range>] $end
+            ids.setdefault(tokens[i+4], tokens[i+3])
+        i += 1
+
+    name = select_channel(list(ids), channel)
+    ident = ids[name]
+
+    edges = []
+    now = 0.0
+    level = None
+    for tok in tokens[i:]:
+        if tok.startswith("#"):
+            now = int(tok[1:]) * scale
+            continue
+        if tok.startswith("$"):
+            continue
+        if tok[0] in "01xXzZ" and tok[1:] == ident:
+            # Undriven means HIGH on a bus with pull-up
+            new = 0 if tok[0] == "0" else 1
+            if new != level:
+                edges.append((now, new))
+                level = new
+    return name, edges
+
+
+def read_sr(path, channel):
+    """Same as read_vcd(), for sigrok session files."""
+    with zipfile.ZipFile(path) as z:
+        meta = configparser.ConfigParser()
+        meta.read_string(z.read("metadata").decode())
+        dev = meta["device 1"]
+
+        m = re.match(r"([\d.]+)\s*([kKmMgG]?)Hz$", dev["samplerate"].strip())
+        if not m:
+            raise CaptureError("invalid samplerate %s" % dev["samplerate"])
+        rate = float(m.group(1)) * UNITS[m.group(2).lower()]
+        unitsize = int(dev.get("unitsize", "1"))
+
+        probes = {}
+        for key, value in dev.items():
+            pm = re.match(r"probe(\d+)$", key)
+            if pm:
+                probes[value] = int(pm.group(1)) - 1
+        name = select_channel(sorted(probes, key=probes.get), channel)
+        bit = probes[name]
+
+        base = dev.get("capturefile", "logic-1")
+        chunks = sorted((n for n in z.namelist() if re.match(re.escape(base) + r"(-\d+)?$", n)),
+                        key=lambda n: int(n.rsplit("-", 1)[1]) if n != base else 0)
+        data = b"".join(z.read(n) for n in chunks)
+
+    table = bytes(((b >> (bit % 8)) & 1) for b in range(256))
+    levels = data[bit // 8::unitsize].translate(table)
+
+    edges = []
+    pos = 0
+    level = levels[0] if levels else 1
+    edges.append((0.0, level))
+    while True:
+        pos = levels.find(b"\x01" if level == 0 else b"\x00", pos)
+        if pos < 0:
+            break
+        level ^= 1
+        edges.append((pos * 1e6 / rate, level))
+    return name, edges
+
+
+def low_pulses(edges):
+    pulses = []
+    fall = None
+    for t, level in edges:
+        if level == 0:
+            fall = t
+        elif fall is not None:
+            pulses.append((fall, t))
+            fall = None
+    return pulses
+
+
+class Slot:
+    def __init__(self, fall, low, label):
+        self.fall = fall
+        self.low = low
+        self.label = label
+        self.result = ""
+
+
+class Decoder:
+    """Decodes the bytes sent after a RESET, to follow the speed and find ROM codes."""
+
+    def __init__(self):
+        self.speed = "std"
+        self.roms = []
+        self.uses = []
+        self.reset()
+
+    def reset(self):
+        self.bits = []
+        self.cmd = None
+        self.rom_bytes = None
+
+    def bit(self, slot, bit):
+        slot.label = "bit %d" % bit
+        self.bits.append(bit)
+        if len(self.bits) < 8:
+            return
+        byte = sum(b << i for i, b in enumerate(self.bits))
+        self.bits = []
+        slot.label += ", byte %02X" % byte
+
+        if self.cmd is None:
+            self.cmd = byte
+            if byte in OPTIONAL_ROM_CMDS and OPTIONAL_ROM_CMDS[byte] not in self.uses:
+                self.uses.append(OPTIONAL_ROM_CMDS[byte])
+            if byte in (ROM_CMD_READ, ROM_CMD_MATCH, ROM_CMD_OVERDRIVE_MATCH):
+                self.rom_bytes = []
+            if byte in (ROM_CMD_OVERDRIVE_SKIP, ROM_CMD_OVERDRIVE_MATCH):
+                self.speed = "od"
+        elif self.rom_bytes is not None:
+            self.rom_bytes.append(byte)
+            if len(self.rom_bytes) == 8:
+                if bytes(self.rom_bytes) not in self.roms:
+                    self.roms.append(bytes(self.rom_bytes))
+                self.rom_bytes = None
+
+
+def convert(pulses, read0_max=None):
+    """Returns the master slots of the capture, the ROM codes found in it and the optional ROM commands it uses."""
+    slots = []
+    dec = Decoder()
+    synced = False
+    last_rise = None
+
+    # A slot's bit is only decoded once the next pulse is known not to be a late READ0 belonging to it
+    pending = None
+
+    for fall, rise in pulses:
+        t = TIMING[dec.speed]
+        low = rise - fall
+        prev = slots[-1] if slots else None
+
+        if prev is not None and prev.label == "RST" and not prev.result and fall - last_rise <= t["presence_start"]:
+            prev.result += "P"
+            last_rise = rise
+            continue
+        if pending is not None and "L" not in pending.result and fall - pending.fall <= t["sample"]:
+            # The master's pulse was over before the slave pulled the bus low for READ0
+            pending.result += "L"
+            last_rise = rise
+            continue
+        last_rise = rise
+
+        if pending is not None:
+            dec.bit(pending, 0 if "L" in pending.result or pending.low > t["sample"] else 1)
+            if "L" in pending.result and pending.low <= t["sample"]:
+                pending.label += " (late READ0)"
+            pending = None
+            t = TIMING[dec.speed]
+
+        if low >= TIMING["od"]["rst_min"] and (dec.speed == "od" or low >= TIMING["std"]["rst_min"]):
+            if low >= TIMING["std"]["rst_min"]:
+                dec.speed = "std"
+            synced = True
+            dec.reset()
+            slots.append(Slot(fall, low, "RST"))
+            continue
+        if not synced:
+            continue
+
+        pending = Slot(fall, low, "")
+        if t["sample"] < low <= (read0_max if read0_max is not None else t["read0_max"]):
+            pending.result += "L"
+        slots.append(pending)
+
+    if pending is not None:
+        dec.bit(pending, 0 if "L" in pending.result or pending.low > TIMING[dec.speed]["sample"] else 1)
+    return slots, dec.roms, dec.uses
+
+
+def write_stream(f, source, channel, f_cpu, rom, uses, slots):
+    ticks_per_us = f_cpu / 1e6
+    header = ["# Converted from %s, channel %s, F_CPU %d Hz" % (os.path.basename(source), channel, f_cpu)]
+    if uses:
+        header.append("# Uses: " + " ".join(uses))
+    if rom is not None:
+        header.append("ROM=%s" % rom.hex().upper())
+    f.write("\n".join(header) + "\n")
+    lines = {}
+    for slot in slots:
+        ticks = min(int(round(slot.low * ticks_per_us)), 65535)
+        f.write("%-16s # %.3f us: %s, LOW %.3f us\n" % ("P=%d:%s" % (ticks, slot.result or "-"), slot.fall,
+                                                         slot.label, slot.low))
+        lines[len(lines) + len(header) + 1] = slot
+    return lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", help="VCD file or sigrok session (.sr)")
+    parser.add_argument("--channel", help="Name or index of the 1-Wire channel (default: guessed)")
+    parser.add_argument("--f-cpu", type=int, default=4000000, help="F_CPU of the host build (default: 4000000)")
+    parser.add_argument("--rom", help="ROM code of the slave, 16 hex digits, family code first")
+    parser.add_argument("--read0-max-us", type=float, help="Longest LOW time that is taken as READ0")
+    parser.add_argument("--output", "-o", help="Write the stream to this file")
+    parser.add_argument("--replay", metavar="OWB_REPLAY", help="Run the stream through this owb_replay binary")
+    parser.add_argument("--disabled", action="append", default=[], choices=sorted(OPTIONAL_ROM_CMDS.values()),
+                        help="ROM command left out of the host build (OWB_<command>_DISABLED), may be repeated")
+    args = parser.parse_args()
+
+    try:
+        if args.capture.lower().endswith(".sr"):
+            channel, edges = read_sr(args.capture, args.channel)
+        else:
+            channel, edges = read_vcd(args.capture, args.channel)
+    except (CaptureError, OSError, KeyError, zipfile.BadZipFile) as e:
+        print("Reading %s failed: %s" % (args.capture, e), file=sys.stderr)
+        return 2
+
+    slots, roms, uses = convert(low_pulses(edges), args.read0_max_us)
+    if not slots:
+        print("No RESET found in the capture", file=sys.stderr)
+        return 2
+
+    if args.rom:
+        rom = bytes.fromhex(args.rom)
+    elif roms:
+        # ROM codes are sent LSB first, i.e. family code first
+        rom = roms[0]
+        if len(roms) > 1:
+            print("Several ROM codes in the capture, using %s" % rom.hex().upper(), file=sys.stderr)
+    else:
+        rom = None
+
+    output = args.output
+    if output is None and args.replay:
+        fd, output = tempfile.mkstemp(suffix=".txt")
+        os.close(fd)
+    if output is None:
+        write_stream(sys.stdout, args.capture, channel, args.f_cpu, rom, uses, slots)
+        return 0
+    with open(output, "w") as f:
+        lines = write_stream(f, args.capture, channel, args.f_cpu, rom, uses, slots)
+
+    if not args.replay:
+        return 0
+    skipped = [cmd for cmd in uses if cmd in args.disabled]
+    if skipped:
+        if args.output is None:
+            os.unlink(output)
+        print("Skipping %s, it uses %s" % (os.path.basename(args.capture), " ".join(skipped)))
+        return 0
+
+    proc = subprocess.run([args.replay, output], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    if args.output is None:
+        os.unlink(output)
+    mismatches = 0
+    for line in proc.stderr.splitlines():
+        m = re.match(r"line (\d+): (.*)", line)
+        if m and int(m.group(1)) in lines:
+            slot = lines[int(m.group(1))]
+            print("%.3f us: %s: %s" % (slot.fall, slot.label, m.group(2)))
+            mismatches += 1
+        else:
+            print(line)
+    print("%d slots replayed, %d mismatch(es)" % (len(slots), mismatches))
+    return 1 if proc.returncode != 0 else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,386 @@
+#!/usr/bin/env python3
+
+# pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+# Copyright (C) 2024 David "Alemarius Nexus" Lerch
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Static worst-case cycle analysis of the ISR, run as a post-build step.
+
+Parses the assembly files generated by SDCC and builds a control flow graph of all functions. The following paths are
+then checked against their budget, and the script fails if any of them is exceeded:
+
+    READ0       From the falling edge to _OWBMarkRead0Low (bus pulled low), over every path from the ISR entry (or
+                _OWBMarkPollEntry with OWB_POLLING_MODE). Budget: --read0-budget-us.
+    READ0 after bus switch
+                With OWB_SECOND_BUS_ENABLED, the same path through _OWBMarkBusSwitch, where the ISR swaps in the
+                state of the other bus. This is too long for the master's LOW pulse, so it's excluded from the READ0
+                path above and only has to pull the bus low before the master samples it.
+                Budget: --read0-switch-budget-us.
+    Latency     From the falling edge to _OWBMarkTimerStart (T16 started). Must not exceed the value of
+                OWB_TIMING_LOW_TO_ISR_LATENCY_TICKS that the firmware was built with, otherwise all pulse length
+                measurements are off. It's exported as _OWBLatencyBaseTicks, plus _OWBBusFallTimeNs and
+                _OWBCompThresholdPermille with OWB_INT_USE_COMP, from which OWB_COMP_EDGE_DELAY_TICKS is derived the
+                same way as in owb.h. The edge delay is added to all of the paths above, since they start at the
+                beginning of the falling edge, but the comparator only fires when it crosses the reference.
+    Handlers    From entry to return of OWBWriteBit() and OWBReadBit(), including everything they call. These run
+                after a slot was recognized and must be done before the next one starts. Budget: --handler-budget-us.
+    Statistics  With OWB_STATS_ENABLED: From entry to return of OWBLLStatsRecordWrite(), which the ISR calls for every
+                WRITE slot. Budget: --stats-budget-us. It's also added to OWBWriteBit() and checked against the
+                handler budget, since both run in the same slot.
+
+The time from the edge to the first instruction of the ISR can't be seen in the code, so it is given by --entry-cycles.
+Busy-wait loops are bounded by T16, not by cycles, so any loop on an analyzed path is reported as an error.
+
+Cycle counts follow the PDK instruction set: 1 cycle per instruction, 2 for jumps, calls, returns, pcadd and idxm, and
+skip instructions take 2 cycles if they skip.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+
+TWO_CYCLE = {"goto", "call", "ret", "reti", "pcadd", "idxm", "ldtabl", "ldtabh", "ldsptl", "ldspth"}
+SKIP = {"t0sn", "t1sn", "t0sn.io", "t1sn.io", "ceqsn", "cneqsn", "izsn", "dzsn"}
+
+# Default cycles from the falling edge to the first analyzed instruction. For the ISR, this is the interrupt response
+# time of the core. For the polling loop, it's the worst case of the two-instruction wait loop.
+DEFAULT_ENTRY_CYCLES = {"isr": 4, "poll": 3}
+
+
+class AnalysisError(Exception):
+    pass
+
+
+class Insn:
+    def __init__(self, func, op, arg, src):
+        self.func = func
+        self.op = op
+        self.arg = arg
+        self.src = src
+        self.index = None
+
+    def __repr__(self):
+        return "%s: %s %s (%s)" % (self.func, self.op, self.arg, self.src)
+
+
+class Program:
+    def __init__(self):
+        self.insns = []
+        self.labels = {}        # (scope, label) -> instruction index
+        self.functions = {}     # name -> instruction index
+        self.marks = {}         # name -> instruction index
+        self.values = {}        # name -> exported value
+        self.scopes = []        # instruction index -> label scope
+
+    def parse(self, path):
+        scope = None
+        func = None
+        pending_labels = []
+        pending_marks = []
+        with open(path) as f:
+            for lineno, line in enumerate(f, 1):
+                line = line.split(";", 1)[0].rstrip()
+                if not line.strip():
+                    continue
+
+                m = re.match(r"^\s*(_\w+)\s*==\s*(\.|\d+|0x[0-9a-fA-F]+)\s*$", line)
+                if m:
+                    if m.group(2) == ".":
+                        pending_marks.append(m.group(1))
+                    else:
+                        self.values[m.group(1)] = int(m.group(2), 0)
+                    continue
+
+                m = re.match(r"^\s*(\w+\$?)\s*::?(.*)$", line)
+                if m:
+                    label = m.group(1)
+                    if not label.endswith("$"):
+                        # Non-local labels start a new function and a new scope for local labels
+                        scope = label
+                        func = label
+                        self.functions[label] = len(self.insns)
+                    pending_labels.append((scope, label))
+                    line = m.group(2)
+                    if not line.strip():
+                        continue
+
+                parts = line.split(None, 1)
+                op = parts[0].lower()
+                if op.startswith("."):
+                    # Assembler directive
+                    continue
+
+                insn = Insn(func, op, parts[1].strip() if len(parts) > 1 else "", "%s:%d" % (path, lineno))
+                insn.index = len(self.insns)
+                for key in pending_labels:
+                    self.labels[key] = insn.index
+                for mark in pending_marks:
+                    self.marks[mark] = insn.index
+                pending_labels = []
+                pending_marks = []
+                self.insns.append(insn)
+                self.scopes.append(scope)
+
+    def target(self, insn):
+        label = insn.arg.split(",")[0].strip()
+        if label.endswith("$"):
+            key = (self.scopes[insn.index], label)
+            if key not in self.labels:
+                raise AnalysisError("%s: unknown local label %s" % (insn.src, label))
+            return self.labels[key]
+        if label not in self.functions:
+            raise AnalysisError("%s: unknown label %s" % (insn.src, label))
+        return self.functions[label]
+
+    def successors(self, i):
+        """Returns a list of (cycles, successor index or None for return) for instruction i, excluding calls."""
+        insn = self.insns[i]
+        op = insn.op
+        if op in ("ret", "reti"):
+            return [(2, None)]
+        if op == "goto":
+            return [(2, self.target(insn))]
+        if op == "pcadd":
+            # Jump table: pcadd is followed by the gotos it jumps to
+            succ = []
+            j = i + 1
+            while j < len(self.insns) and self.insns[j].op == "goto" and self.insns[j].func == insn.func:
+                succ.append((2, j))
+                j += 1
+            if not succ:
+                raise AnalysisError("%s: pcadd without jump table" % insn.src)
+            return succ
+        if op in SKIP:
+            return [(1, i + 1), (2, i + 2)]
+        return [(2 if op in TWO_CYCLE else 1, i + 1)]
+
+
+class Analyzer:
+    def __init__(self, prog):
+        self.prog = prog
+        self.func_cache = {}
+
+    def call_cost(self, i):
+        insn = self.prog.insns[i]
+        if insn.op != "call":
+            return 0
+        return self.function_cycles(insn.arg.strip())
+
+    def function_cycles(self, name, stack=()):
+        """Worst-case cycles from entry to return of a function, including its callees."""
+        if name in self.func_cache:
+            return self.func_cache[name]
+        if name in stack:
+            raise AnalysisError("recursion through %s" % " -> ".join(stack + (name,)))
+        if name not in self.prog.functions:
+            raise AnalysisError("unknown function %s" % name)
+
+        memo = {}
+        active = set()
+
+        def longest(i):
+            if i in memo:
+                return memo[i]
+            if i in active:
+                raise AnalysisError("loop in %s at %s" % (name, self.prog.insns[i].src))
+            active.add(i)
+            insn = self.prog.insns[i]
+            extra = 0
+            if insn.op == "call":
+                extra = self.function_cycles(insn.arg.strip(), stack + (name,))
+            best = 0
+            for cycles, succ in self.prog.successors(i):
+                best = max(best, cycles + extra + (longest(succ) if succ is not None else 0))
+            active.discard(i)
+            memo[i] = best
+            return best
+
+        result = longest(self.prog.functions[name])
+        self.func_cache[name] = result
+        return result
+
+    def path_cycles(self, start, target, avoid=()):
+        """Worst-case cycles from instruction start to instruction target (excluding target itself), over all paths
+        that reach target without passing through start again or through any instruction in avoid. Returns None if
+        target is unreachable."""
+        # Only instructions that can reach the target matter. Loops elsewhere (e.g. the busy-wait loops for W0 and
+        # RST) don't, as long as they can't lead back to the target.
+        preds = {}
+        for i in range(len(self.prog.insns)):
+            if i in avoid:
+                continue
+            for _, succ in self.prog.successors(i):
+                if succ is not None and succ != start and succ not in avoid:
+                    preds.setdefault(succ, []).append(i)
+        relevant = {target}
+        todo = [target]
+        while todo:
+            for p in preds.get(todo.pop(), []):
+                if p not in relevant:
+                    relevant.add(p)
+                    todo.append(p)
+        if start not in relevant:
+            return None
+
+        memo = {}
+        active = set()
+
+        def longest(i):
+            if i == target:
+                return 0
+            if i in memo:
+                return memo[i]
+            if i in active:
+                raise AnalysisError("loop on path to target at %s" % self.prog.insns[i].src)
+            active.add(i)
+            best = 0
+            for cycles, succ in self.prog.successors(i):
+                if succ in relevant and succ != start:
+                    best = max(best, cycles + self.call_cost(i) + longest(succ))
+            active.discard(i)
+            memo[i] = best
+            return best
+
+        return longest(start)
+
+
+def comp_edge_delay_ticks(values, f_cpu):
+    """OWB_COMP_EDGE_DELAY_TICKS of owb.h, from the exported values. 0 unless built with OWB_INT_USE_COMP."""
+    if "_OWBBusFallTimeNs" not in values:
+        return 0
+    if "_OWBCompThresholdPermille" not in values:
+        raise AnalysisError("_OWBCompThresholdPermille not exported")
+    fall_ns = values["_OWBBusFallTimeNs"]
+    permille = values["_OWBCompThresholdPermille"]
+    return (fall_ns * (1000 - permille) // 1000 * (f_cpu // 1000000) + 999) // 1000
+
+
+def find_asm_files(paths):
+    """Accept .asm files directly, or object files (.rel), in which case the .asm file next to them is used."""
+    result = []
+    for path in paths:
+        if path.endswith(".asm"):
+            result.append(path)
+            continue
+        base = re.sub(r"\.rel$", "", path)
+        for candidate in (base + ".asm", re.sub(r"\.c$", "", base) + ".asm"):
+            if os.path.exists(candidate):
+                result.append(candidate)
+                break
+        else:
+            raise AnalysisError("no assembly file found for %s" % path)
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("files", nargs="+", help="Assembly files generated by SDCC, or the object files next to them")
+    parser.add_argument("--f-cpu", type=int, required=True, help="System clock frequency in Hz")
+    parser.add_argument("--entry-cycles", type=int,
+                        help="Cycles from the falling edge to the first instruction (default: %d for the ISR, %d for "
+                             "OWB_POLLING_MODE)" % (DEFAULT_ENTRY_CYCLES["isr"], DEFAULT_ENTRY_CYCLES["poll"]))
+    parser.add_argument("--read0-budget-us", type=float, default=5.0,
+                        help="Maximum time from the falling edge until the bus is pulled low for READ0")
+    parser.add_argument("--read0-switch-budget-us", type=float, default=15.0,
+                        help="Maximum time from the falling edge until the bus is pulled low for READ0 right after "
+                             "switching to the other bus (OWB_SECOND_BUS_ENABLED)")
+    parser.add_argument("--handler-budget-us", type=float, default=25.0,
+                        help="Maximum time for OWBWriteBit() and OWBReadBit()")
+    parser.add_argument("--stats-budget-us", type=float, default=10.0,
+                        help="Maximum time for recording a WRITE slot in the statistics (OWB_STATS_ENABLED)")
+    args = parser.parse_args()
+
+    try:
+        prog = Program()
+        for path in find_asm_files(args.files):
+            prog.parse(path)
+
+        if "_interrupt" in prog.functions:
+            mode, entry = "isr", prog.functions["_interrupt"]
+        elif "_OWBMarkPollEntry" in prog.marks:
+            mode, entry = "poll", prog.marks["_OWBMarkPollEntry"]
+        else:
+            raise AnalysisError("neither _interrupt nor _OWBMarkPollEntry found")
+        entry_cycles = args.entry_cycles if args.entry_cycles is not None else DEFAULT_ENTRY_CYCLES[mode]
+
+        for mark in ("_OWBMarkRead0Low", "_OWBMarkTimerStart"):
+            if mark not in prog.marks:
+                raise AnalysisError("marker %s not found" % mark)
+
+        analyzer = Analyzer(prog)
+        us = lambda cycles: cycles * 1e6 / args.f_cpu
+        failed = False
+
+        def report(name, cycles, budget_cycles):
+            nonlocal failed
+            ok = cycles <= budget_cycles
+            failed = failed or not ok
+            print("    %-26s %4d cycles = %6.2fus (budget %4d cycles = %6.2fus)%s"
+                  % (name, cycles, us(cycles), budget_cycles, us(budget_cycles), "" if ok else "  EXCEEDED"))
+
+        print("ISR cycle analysis (%s @ %.1fMHz, %d entry cycles):" % (mode, args.f_cpu / 1e6, entry_cycles))
+
+        # Ticks are system clock cycles (T16 runs from SYSCLK)
+        if "_OWBLatencyBaseTicks" not in prog.values:
+            raise AnalysisError("_OWBLatencyBaseTicks not exported")
+        edge_delay = comp_edge_delay_ticks(prog.values, args.f_cpu)
+        if edge_delay:
+            print("    %-26s %4d cycles = %6.2fus" % ("Comparator edge delay", edge_delay, us(edge_delay)))
+
+        # The bus switch is checked on its own, so it's left out of the regular READ0 path
+        switch = prog.marks.get("_OWBMarkBusSwitch")
+        avoid = () if switch is None else (switch,)
+        read0 = analyzer.path_cycles(entry, prog.marks["_OWBMarkRead0Low"], avoid)
+        if read0 is None:
+            raise AnalysisError("_OWBMarkRead0Low not reachable from the entry")
+        report("Edge to READ0 pull-low", edge_delay + entry_cycles + read0,
+               int(args.read0_budget_us * args.f_cpu / 1e6))
+
+        if switch is not None:
+            to_switch = analyzer.path_cycles(entry, switch)
+            from_switch = analyzer.path_cycles(switch, prog.marks["_OWBMarkRead0Low"])
+            if to_switch is None or from_switch is None:
+                raise AnalysisError("_OWBMarkRead0Low not reachable through _OWBMarkBusSwitch")
+            report("Edge to READ0 after switch", edge_delay + entry_cycles + to_switch + from_switch,
+                   int(args.read0_switch_budget_us * args.f_cpu / 1e6))
+
+        timer = analyzer.path_cycles(entry, prog.marks["_OWBMarkTimerStart"])
+        if timer is None:
+            raise AnalysisError("_OWBMarkTimerStart not reachable from the entry")
+        report("Edge to T16 start", edge_delay + entry_cycles + timer,
+               prog.values["_OWBLatencyBaseTicks"] + edge_delay)
+
+        handler_budget = int(args.handler_budget_us * args.f_cpu / 1e6)
+        for func in ("_OWBWriteBit", "_OWBReadBit"):
+            report(func[1:] + "()", 2 + analyzer.function_cycles(func), handler_budget)
+
+        if "_OWBLLStatsRecordWrite" in prog.functions:
+            stats = 2 + analyzer.function_cycles("_OWBLLStatsRecordWrite")
+            report("OWBLLStatsRecordWrite()", stats, int(args.stats_budget_us * args.f_cpu / 1e6))
+            report("OWBWriteBit() + statistics", stats + 2 + analyzer.function_cycles("_OWBWriteBit"), handler_budget)
+    except AnalysisError as e:
+        print("ISR cycle analysis failed: %s" % e, file=sys.stderr)
+        return 2
+
+    if failed:
+        print("ISR cycle budget EXCEEDED", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+
+# pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+# Copyright (C) 2024 David "Alemarius Nexus" Lerch
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Code size, RAM and stack report of firmware images, run as a post-build step.
+
+For each image, the following is determined:
+
+    Code words  From the Intel HEX file written by the linker: The number of program words used, and the highest one,
+                which must be below the size of the device's program memory.
+    RAM bytes   From the linker map file next to it: RAM taken up by variables, i.e. the start of the stack (SSEG
+                area), or the end of the highest RAM area if there is no stack area. SDCC allocates local variables
+                statically on PDK, so they are included here.
+    Stack bytes From the assembly files generated by SDCC (next to the object files): The worst case over all call
+                chains from main(), plus the ISR on top of that, since it can interrupt anywhere. Every call and every
+                push takes 2 bytes. Calls to functions without assembly (e.g. from the SDCC library) only count
+                their return address, and are listed in the output.
+
+The first image is checked against the limits of the device (RAM bytes plus stack bytes must fit into RAM), and the
+script fails if it doesn't fit, unless --no-fail is given. All further images are reported relative to the first one,
+as the cost of whatever the first image has and they don't (e.g. a single feature).
+"""
+
+import argparse
+import os
+import re
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from owb_isr_cycles import AnalysisError, Program, find_asm_files  # noqa: E402
+
+
+# Program memory in words and RAM in bytes of the supported devices
+DEVICES = {
+    "PMS150C": (1024, 64),
+    "PMS15A": (1024, 64),
+    "PMS152": (1280, 80),
+    "PMS154C": (2048, 128),
+    "PFS154": (2048, 128),
+    "PFS172": (2048, 128),
+    "PFS173": (3072, 256),
+}
+
+# Linker areas that live in RAM
+RAM_AREAS = ("RSEG0", "DATA", "OSEG", "SSEG")
+
+
+class Image:
+    def __init__(self, label, ihx, objects):
+        self.label = label
+        self.ihx = ihx
+        self.objects = objects
+        self.code_words = 0
+        self.code_end = 0
+        self.ram = 0
+        self.stack = 0
+        self.unknown_calls = set()
+
+    def analyze(self):
+        self.read_ihx()
+        self.read_map()
+        self.analyze_stack()
+
+    def read_ihx(self):
+        words = set()
+        with open(self.ihx) as f:
+            for line in f:
+                line = line.strip()
+                if not line.startswith(":"):
+                    continue
+                data = bytes.fromhex(line[1:])
+                count, addr, rectype = data[0], (data[1] << 8) | data[2], data[3]
+                if rectype == 0:
+                    words.update((addr + i) // 2 for i in range(count))
+        if not words:
+            raise AnalysisError("%s: no program data" % self.ihx)
+        self.code_words = len(words)
+        self.code_end = max(words) + 1
+
+    def read_map(self):
+        map_file = re.sub(r"\.[^./]*$", "", self.ihx) + ".map"
+        areas = {}
+        with open(map_file) as f:
+            for line in f:
+                m = re.match(r"^\s*(\w+)\s+([0-9A-Fa-f]{4,8})\s+([0-9A-Fa-f]{4,8})\s*=\s*\d+\.\s*bytes", line)
+                if m and m.group(1) in RAM_AREAS:
+                    areas[m.group(1)] = (int(m.group(2), 16), int(m.group(3), 16))
+        if not areas:
+            raise AnalysisError("%s: no RAM areas found" % map_file)
+        if "SSEG" in areas:
+            self.ram = areas["SSEG"][0]
+        else:
+            self.ram = max(addr + size for addr, size in areas.values())
+
+    def analyze_stack(self):
+        prog = Program()
+        for path in find_asm_files(self.objects):
+            prog.parse(path)
+
+        cache = {}
+
+        def function_stack(name, stack=()):
+            if name in cache:
+                return cache[name]
+            if name in stack:
+                raise AnalysisError("recursion through %s" % " -> ".join(stack + (name,)))
+            if name not in prog.functions:
+                self.unknown_calls.add(name)
+                return 0
+
+            start = prog.functions[name]
+            depth = {start: 0}
+            todo = [start]
+            worst = 0
+            while todo:
+                i = todo.pop()
+                insn = prog.insns[i]
+                d = depth[i]
+                if insn.op == "call":
+                    worst = max(worst, d + 2 + function_stack(insn.arg.strip(), stack + (name,)))
+                elif insn.op == "push":
+                    d += 2
+                elif insn.op == "pop":
+                    d -= 2
+                worst = max(worst, d)
+                for _, succ in prog.successors(i):
+                    if succ is not None and succ not in depth:
+                        depth[succ] = d
+                        todo.append(succ)
+            cache[name] = worst
+            return worst
+
+        if "_main" not in prog.functions:
+            raise AnalysisError("%s: _main not found" % self.label)
+        self.stack = function_stack("_main")
+        if "_interrupt" in prog.functions:
+            # The interrupt pushes the return address
+            self.stack += 2 + function_stack("_interrupt")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--device", required=True, help="Device name, e.g. PMS150C")
+    parser.add_argument("--code-words", type=int, help="Program memory size in words (default: from the device)")
+    parser.add_argument("--ram-bytes", type=int, help="RAM size in bytes (default: from the device)")
+    parser.add_argument("--no-fail", action="store_true", help="Only report, even if the first image doesn't fit")
+    parser.add_argument("--image", nargs="+", action="append", required=True, metavar=("LABEL", "IHX"),
+                        help="Label, Intel HEX file and object files of an image. Can be given multiple times.")
+    args = parser.parse_args()
+
+    code_limit, ram_limit = DEVICES.get(args.device, (None, None))
+    code_limit = args.code_words or code_limit
+    ram_limit = args.ram_bytes or ram_limit
+    if code_limit is None or ram_limit is None:
+        print("Unknown device %s, use --code-words and --ram-bytes" % args.device, file=sys.stderr)
+        return 2
+
+    try:
+        images = []
+        for spec in args.image:
+            if len(spec) < 3:
+                raise AnalysisError("--image needs a label, an Intel HEX file and at least one object file")
+            image = Image(spec[0], spec[1], spec[2:])
+            image.analyze()
+            images.append(image)
+    except (AnalysisError, OSError) as e:
+        print("Size report failed: %s" % e, file=sys.stderr)
+        return 2
+
+    first = images[0]
+    fits_code = first.code_end <= code_limit
+    fits_ram = first.ram + first.stack <= ram_limit
+
+    print("Size report for %s (%d code words, %d bytes RAM):" % (args.device, code_limit, ram_limit))
+    print("    %-36s %4d code words (up to word %d)%s" % (first.label, first.code_words, first.code_end - 1,
+                                                         "" if fits_code else "  EXCEEDED"))
+    print("    %-36s %4d bytes RAM + %d bytes stack = %d bytes%s" % ("", first.ram, first.stack,
+                                                                     first.ram + first.stack,
+                                                                     "" if fits_ram else "  EXCEEDED"))
+    if first.unknown_calls:
+        print("    Stack of %s not analyzed" % ", ".join(sorted(first.unknown_calls)))
+
+    if len(images) > 1:
+        print("    Difference of %s to:" % first.label)
+        print("    %-36s %10s %10s %10s" % ("", "Code words", "RAM bytes", "Stack"))
+        for image in images[1:]:
+            print("    %-36s %+10d %+10d %+10d" % (image.label, first.code_words - image.code_words,
+                                                  first.ram - image.ram, first.stack - image.stack))
+
+    if not (fits_code and fits_ram):
+        print("Firmware does NOT fit into %s" % args.device, file=sys.stderr)
+        return 0 if args.no_fail else 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
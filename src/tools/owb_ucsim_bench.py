@@ -0,0 +1,352 @@
+#!/usr/bin/env python3
+
+# pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+# Copyright (C) 2024 David "Alemarius Nexus" Lerch
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Cycle-accurate ISR benchmark running the firmware image in the ucsim PDK simulator.
+
+The firmware is single-stepped in ucsim_pdk while this script plays the role of a 1-Wire master: It drives the OWB pin
+with scripted waveforms (RESET, READ ROM, SEARCH ROM), samples the bus for READ slots and records the cycle counter
+whenever the program counter hits one of the interesting symbols from the linker map file:
+
+    _interrupt              ISR entry (or _OWBMarkPollEntry with OWB_POLLING_MODE)
+    _OWBMarkRead0Low        Bus pulled low for READ0 (see OWBMark() in owb.h)
+    _OWBMarkISRExit         Start of the ISR epilog
+    _OWBWriteBit            High-level WRITE handler (measured until it returns)
+    _OWBReadBit             High-level READ handler (measured until it returns)
+
+The simulator doesn't know anything about the 1-Wire bus, so the pin's input value and the edge IRQ flag are written
+directly into the I/O space. Only the PA0 external interrupt is supported (not OWB_INT_USE_COMP). The edge that raises
+the IRQ flag is chosen by reading _OWBLLResetPhase from RAM, because INTEGS is write-only. The T16 interrupt that ends
+the phases of a RST is left to the simulator's timer model.
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+
+
+# I/O register addresses and bits. These are the same for PDK13, PDK14 and PDK15 devices.
+IO_SP = 0x02
+IO_INTRQ = 0x05
+IO_PA = 0x10
+IO_PAC = 0x11
+INTRQ_PA0 = 0x01
+
+# OWB_RESET_PHASE_WAIT_IDLE in owbll.h: The firmware waits for the rising edge at the end of a RST
+RESET_PHASE_WAIT_IDLE = 1
+
+# The READ0 deadline from the master's falling edge, see the comments at the top of interrupt.c
+READ0_BUDGET_US = 5.0
+
+
+class UCSim:
+    """Minimal driver for the ucsim command line interface."""
+
+    PROMPT = re.compile(r"(^|\n)\d*> $")
+
+    def __init__(self, ucsim, arch, f_cpu, image, io_space, ram_space):
+        self.io_space = io_space
+        self.ram_space = ram_space
+        self.proc = subprocess.Popen(
+            [ucsim, "-t", arch.upper(), "-X", str(f_cpu), image],
+            stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+            text=True, bufsize=0)
+        self._read_until_prompt()
+
+    def _read_until_prompt(self):
+        out = ""
+        while not self.PROMPT.search(out):
+            c = self.proc.stdout.read(1)
+            if not c:
+                raise RuntimeError("ucsim terminated unexpectedly:\n" + out)
+            out += c
+        return out
+
+    def cmd(self, line):
+        self.proc.stdin.write(line + "\n")
+        return self._read_until_prompt()
+
+    def close(self):
+        try:
+            self.proc.stdin.write("quit\n")
+        except OSError:
+            pass
+        self.proc.wait(timeout=5)
+
+    def step(self):
+        self.cmd("step")
+
+    def pc(self):
+        m = re.search(r"0x([0-9a-fA-F]+)", self.cmd("pc"))
+        return int(m.group(1), 16)
+
+    def ticks(self):
+        m = re.search(r"\((\d+)\s*clks?\)", self.cmd("state"))
+        if not m:
+            raise RuntimeError("Unable to parse cycle counter from ucsim state output")
+        return int(m.group(1))
+
+    def get_io(self, addr):
+        out = self.cmd("get %s 0x%02x" % (self.io_space, addr))
+        m = re.search(r"0x%02x\s+([0-9a-fA-F]{2})" % addr, out, re.IGNORECASE)
+        return int(m.group(1), 16)
+
+    def get_ram(self, addr):
+        out = self.cmd("get %s 0x%02x" % (self.ram_space, addr))
+        m = re.search(r"0x%02x\s+([0-9a-fA-F]{2})" % addr, out, re.IGNORECASE)
+        return int(m.group(1), 16)
+
+    def set_io(self, addr, value):
+        self.cmd("set memory %s 0x%02x 0x%02x" % (self.io_space, addr, value & 0xFF))
+
+
+def read_map_symbols(map_file, word_addresses):
+    """Read global symbol addresses from the SDCC linker map file. Returns two dicts name -> address: one with code
+    symbols as PC (in words), and one with the unconverted addresses for data symbols."""
+    symbols = {}
+    raw = {}
+    with open(map_file) as f:
+        for line in f:
+            m = re.match(r"^\s*(?:[0-9A-Fa-f]+:)?([0-9A-Fa-f]{4,8})\s+(_\w+)", line)
+            if m:
+                addr = int(m.group(1), 16)
+                symbols[m.group(2)] = addr if word_addresses else addr // 2
+                raw[m.group(2)] = addr
+    return symbols, raw
+
+
+class Stats:
+    def __init__(self):
+        self.values = []
+
+    def add(self, v):
+        self.values.append(v)
+
+    def fmt(self, f_cpu):
+        if not self.values:
+            return "%8s" % "-"
+        mx = max(self.values)
+        return "%4d avg / %4d max cyc (%6.2fus)" % (sum(self.values) // len(self.values), mx, mx * 1e6 / f_cpu)
+
+
+class Bench:
+    def __init__(self, sim, symbols, reset_phase_addr, f_cpu, owb_pin, read_low_us):
+        self.sim = sim
+        self.sym = symbols
+        self.reset_phase_addr = reset_phase_addr
+        self.entry = symbols.get("_interrupt", symbols.get("_OWBMarkPollEntry"))
+        self.f_cpu = f_cpu
+        self.pin_mask = 1 << owb_pin
+        self.read_low_us = read_low_us
+
+        self.master_low = False
+        self.bus_high = True
+        self.edge_tick = 0
+        self.isr_entry_tick = None
+        self.pending_calls = []
+
+        self.reset_stats()
+
+    def reset_stats(self):
+        self.stats = {
+            "isr": Stats(),
+            "read0": Stats(),
+            "write_bit": Stats(),
+            "read_bit": Stats(),
+        }
+
+    def us(self, us):
+        return int(us * self.f_cpu / 1000000)
+
+    def slave_pulls_low(self):
+        return (self.sim.get_io(IO_PAC) & self.pin_mask) != 0
+
+    def update_bus(self, tick):
+        high = not self.master_low and not self.slave_pulls_low()
+        if high != self.bus_high:
+            pa = self.sim.get_io(IO_PA)
+            self.sim.set_io(IO_PA, (pa | self.pin_mask) if high else (pa & ~self.pin_mask))
+            # Emulate the edge detector of the interrupt controller
+            rising = self.sim.get_ram(self.reset_phase_addr) == RESET_PHASE_WAIT_IDLE
+            if high == rising:
+                self.sim.set_io(IO_INTRQ, self.sim.get_io(IO_INTRQ) | INTRQ_PA0)
+            if not high:
+                self.edge_tick = tick
+            self.bus_high = high
+
+    def step(self):
+        self.sim.step()
+        tick = self.sim.ticks()
+        pc = self.sim.pc()
+
+        if pc == self.entry:
+            self.isr_entry_tick = tick
+        elif pc == self.sym.get("_OWBMarkISRExit") and self.isr_entry_tick is not None:
+            self.stats["isr"].add(tick - self.isr_entry_tick)
+            self.isr_entry_tick = None
+        elif pc == self.sym.get("_OWBMarkRead0Low"):
+            self.stats["read0"].add(tick - self.edge_tick)
+        elif pc == self.sym.get("_OWBWriteBit"):
+            self.pending_calls.append(("write_bit", tick, self.sim.get_io(IO_SP)))
+        elif pc == self.sym.get("_OWBReadBit"):
+            self.pending_calls.append(("read_bit", tick, self.sim.get_io(IO_SP)))
+
+        if self.pending_calls:
+            name, start, sp = self.pending_calls[-1]
+            if self.sim.get_io(IO_SP) == ((sp - 2) & 0xFF):
+                self.stats[name].add(tick - start)
+                self.pending_calls.pop()
+
+        self.update_bus(tick)
+        return tick
+
+    def run_until(self, tick):
+        now = self.sim.ticks()
+        while now < tick:
+            now = self.step()
+        return now
+
+    def bus_is_low(self):
+        return self.master_low or self.slave_pulls_low()
+
+    def slot(self, low_us, total_us, sample_us=None):
+        start = self.sim.ticks()
+        self.master_low = True
+        self.update_bus(start)
+        self.run_until(start + self.us(low_us))
+        self.master_low = False
+        self.update_bus(self.sim.ticks())
+        sample = None
+        if sample_us is not None:
+            self.run_until(start + self.us(sample_us))
+            sample = not self.bus_is_low()
+        self.run_until(start + self.us(total_us))
+        return sample
+
+    def reset(self):
+        presence = not self.slot(480, 480 + 70, 480 + 70)
+        self.run_until(self.sim.ticks() + self.us(410))
+        return presence
+
+    def write_bit(self, bit):
+        if bit:
+            self.slot(6, 70)
+        else:
+            self.slot(60, 70)
+
+    def read_bit(self):
+        return 1 if self.slot(self.read_low_us, 70, 15) else 0
+
+    def write_byte(self, b):
+        for i in range(8):
+            self.write_bit((b >> i) & 1)
+
+    def read_byte(self):
+        return sum(self.read_bit() << i for i in range(8))
+
+    # ********** Scripted operations **********
+
+    def op_reset(self):
+        return "presence" if self.reset() else "NO PRESENCE"
+
+    def op_read_rom(self):
+        self.reset()
+        self.write_byte(0x33)
+        return "ROM " + "".join("%02X" % self.read_byte() for _ in range(8))
+
+    def op_search_rom(self):
+        self.reset()
+        self.write_byte(0xF0)
+        rom = 0
+        for i in range(64):
+            b = self.read_bit()
+            nb = self.read_bit()
+            if b and nb:
+                return "no device responded at bit %d" % i
+            # Single slave, so there are no discrepancies: Simply follow its bit.
+            self.write_bit(b)
+            rom |= b << i
+        return "ROM " + "".join("%02X" % ((rom >> (8*i)) & 0xFF) for i in range(8))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image", help="Firmware image (.ihx) built by SDCC")
+    parser.add_argument("--map", help="Linker map file (default: image with .map extension)")
+    parser.add_argument("--ucsim", default="ucsim_pdk", help="ucsim PDK simulator executable")
+    parser.add_argument("--arch", default="pdk13", help="PDK architecture (pdk13, pdk14, pdk15)")
+    parser.add_argument("--f-cpu", type=int, default=4000000, help="System clock frequency in Hz")
+    parser.add_argument("--owb-pin", type=int, default=0, help="OWB pin number on port A")
+    parser.add_argument("--read-low-us", type=float, default=5.0,
+                        help="Length of the master's LOW pulse for READ slots in microseconds")
+    parser.add_argument("--io-space", default="sfr", help="Name of the I/O memory space in ucsim")
+    parser.add_argument("--ram-space", default="ram", help="Name of the RAM memory space in ucsim")
+    parser.add_argument("--map-word-addresses", action="store_true",
+                        help="Map file addresses are already word addresses")
+    parser.add_argument("--no-fail", action="store_true", help="Don't fail if the READ0 budget is exceeded")
+    args = parser.parse_args()
+
+    map_file = args.map or re.sub(r"\.[^./]*$", "", args.image) + ".map"
+    symbols, raw_symbols = read_map_symbols(map_file, args.map_word_addresses)
+    if "_interrupt" not in symbols and "_OWBMarkPollEntry" not in symbols:
+        print("Neither _interrupt nor _OWBMarkPollEntry found in %s" % map_file, file=sys.stderr)
+        return 2
+    for s in ("_OWBMarkRead0Low", "_OWBMarkISRExit", "_OWBWriteBit", "_OWBReadBit", "_OWBLLResetPhase"):
+        if s not in symbols:
+            print("Symbol %s not found in %s" % (s, map_file), file=sys.stderr)
+            return 2
+
+    sim = UCSim(args.ucsim, args.arch, args.f_cpu, args.image, args.io_space, args.ram_space)
+    bench = Bench(sim, symbols, raw_symbols["_OWBLLResetPhase"], args.f_cpu, args.owb_pin, args.read_low_us)
+
+    print("========== %s @ %.1fMHz: %s ==========" % (args.arch, args.f_cpu / 1e6, args.image))
+
+    # Run through startup code until the bus is idle and the interrupt is enabled
+    sim.set_io(IO_PA, sim.get_io(IO_PA) | bench.pin_mask)
+    bench.run_until(bench.us(1000))
+
+    worst_read0 = 0
+    try:
+        for name, op in (("RESET", bench.op_reset),
+                         ("READ ROM", bench.op_read_rom),
+                         ("SEARCH ROM", bench.op_search_rom)):
+            bench.reset_stats()
+            result = op()
+            s = bench.stats
+            print("%-10s  %s" % (name, result))
+            print("    ISR (entry to epilog):   %s" % s["isr"].fmt(args.f_cpu))
+            print("    Edge to READ0 pull-low:  %s" % s["read0"].fmt(args.f_cpu))
+            print("    OWBWriteBit():           %s" % s["write_bit"].fmt(args.f_cpu))
+            print("    OWBReadBit():            %s" % s["read_bit"].fmt(args.f_cpu))
+            if s["read0"].values:
+                worst_read0 = max(worst_read0, max(s["read0"].values))
+    finally:
+        sim.close()
+
+    # NOTE: The simulator raises the IRQ flag right at the edge, so the latency of the edge detector itself (which is
+    # significant for OWB_INT_USE_COMP) is NOT included here.
+    worst_us = worst_read0 * 1e6 / args.f_cpu
+    print("Worst-case READ0 latency: %d cycles = %.2fus (budget %.2fus)" % (worst_read0, worst_us, READ0_BUDGET_US))
+    if worst_us > READ0_BUDGET_US:
+        print("READ0 budget EXCEEDED", file=sys.stderr)
+        return 0 if args.no_fail else 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
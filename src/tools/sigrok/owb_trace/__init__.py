@@ -0,0 +1,34 @@
+##
+## pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+## Copyright (C) 2024 David "Alemarius Nexus" Lerch
+##
+## This program is free software: you can redistribute it and/or modify
+## it under the terms of the GNU General Public License as published by
+## the Free Software Foundation, either version 3 of the License, or
+## (at your option) any later version.
+##
+## This program is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+##
+## You should have received a copy of the GNU General Public License
+## along with this program.  If not, see <https://www.gnu.org/licenses/>.
+##
+
+'''
+Decodes the event trace that pdk-owb-slave emits on its debug pin when built with OWB_DEBUG_TRACE (see DbgEvent() in
+owb.h). Each event is a burst of 1-cycle pulses, and the number of pulses identifies the event: READ0 pull-low, ISR
+entry, WRITE1, WRITE0, RST and change of the high-level state.
+
+If the 1-Wire bus is connected as well, each event is labeled with the number of CPU cycles since the last falling
+edge of the bus, which gives a cycle-level profile of the ISR. Add the onewire_link decoder on the same bus to see the
+events next to the decoded slots.
+
+The logic analyzer must sample at no less than 3 times the CPU clock of the slave (option f_cpu).
+
+To use it, copy or link this directory into the decoder path of libsigrokdecode, e.g. ~/.local/share/libsigrokdecode/
+decoders, or point SIGROKDECODE_DIR at the parent directory.
+'''
+
+from .pd import Decoder
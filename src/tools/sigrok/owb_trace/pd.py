@@ -0,0 +1,122 @@
+##
+## pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+## Copyright (C) 2024 David "Alemarius Nexus" Lerch
+##
+## This program is free software: you can redistribute it and/or modify
+## it under the terms of the GNU General Public License as published by
+## the Free Software Foundation, either version 3 of the License, or
+## (at your option) any later version.
+##
+## This program is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+##
+## You should have received a copy of the GNU General Public License
+## along with this program.  If not, see <https://www.gnu.org/licenses/>.
+##
+
+import sigrokdecode as srd
+
+# Events by their number of pulses, as the OWB_DBG_EVENT_* constants in owb.h: (annotation ID, texts from long to short)
+EVENTS = {
+    1: ('read0', ['READ0 pull-low', 'READ0', 'R0']),
+    2: ('isr-entry', ['ISR entry', 'ISR', 'I']),
+    3: ('write1', ['WRITE1', 'W1']),
+    4: ('write0', ['WRITE0', 'W0']),
+    5: ('reset', ['RST detected', 'RST', 'R']),
+    6: ('state', ['State change', 'State', 'S']),
+}
+
+ANN_UNKNOWN = len(EVENTS)
+
+class SamplerateError(Exception):
+    pass
+
+class Decoder(srd.Decoder):
+    api_version = 3
+    id = 'owb_trace'
+    name = 'OWB trace'
+    longname = 'pdk-owb-slave event trace'
+    desc = 'Event trace of the pdk-owb-slave firmware on its debug pin.'
+    license = 'gplv3+'
+    inputs = ['logic']
+    outputs = []
+    tags = ['Debug/trace']
+    channels = (
+        {'id': 'dbg', 'name': 'DBG', 'desc': 'Debug pin of the slave'},
+    )
+    optional_channels = (
+        {'id': 'owb', 'name': 'OWB', 'desc': '1-Wire bus, to count cycles from its falling edge'},
+    )
+    options = (
+        {'id': 'f_cpu', 'desc': 'CPU clock of the slave (Hz)', 'default': 8000000},
+    )
+    annotations = tuple((EVENTS[n][0], EVENTS[n][1][0]) for n in sorted(EVENTS)) + (
+        ('unknown', 'Unknown event'),
+    )
+    annotation_rows = (
+        ('events', 'Events', tuple(range(len(EVENTS) + 1))),
+    )
+
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.samplerate = None
+        self.last_fall = None
+
+    def metadata(self, key, value):
+        if key == srd.SRD_CONF_SAMPLERATE:
+            self.samplerate = value
+
+    def start(self):
+        self.out_ann = self.register(srd.OUTPUT_ANN)
+
+    def put_event(self, start, end, count, cycle):
+        if count in EVENTS:
+            ann = sorted(EVENTS).index(count)
+            texts = list(EVENTS[count][1])
+        else:
+            ann = ANN_UNKNOWN
+            texts = ['Unknown event (%d pulses)' % count, '?']
+
+        if self.last_fall is not None:
+            # The pin goes HIGH one cycle after the instruction that sets it, which is included here
+            cycles = int(round((start - self.last_fall) / cycle))
+            texts = ['%s @ %d cycles' % (texts[0], cycles), '%s @ %d' % (texts[-1], cycles)] + texts
+
+        self.put(start, end, self.out_ann, [ann, texts])
+
+    def decode(self):
+        if not self.samplerate:
+            raise SamplerateError('Cannot decode without samplerate.')
+
+        # Samples per CPU cycle. The pulses of an event are 1 cycle apart, while events are at least 2 cycles apart.
+        cycle = self.samplerate / self.options['f_cpu']
+        gap = max(1, int(cycle * 1.5 + 0.5))
+        has_owb = self.has_channel(1)
+
+        while True:
+            conds = [{0: 'r'}]
+            if has_owb:
+                conds.append({1: 'f'})
+            self.wait(conds)
+
+            if has_owb and self.matched[1]:
+                self.last_fall = self.samplenum
+                if not self.matched[0]:
+                    continue
+
+            # Count the pulses of this event, until the pin stays LOW for longer than between two pulses
+            start = self.samplenum
+            count = 1
+            while True:
+                self.wait({0: 'f'})
+                end = self.samplenum
+                self.wait([{0: 'r'}, {'skip': gap}])
+                if not self.matched[0]:
+                    break
+                count += 1
+
+            self.put_event(start, end, count, cycle)
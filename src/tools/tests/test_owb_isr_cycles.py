@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+
+# pdk-owb-slave - A OneWire slave implementation for Padauk microcontrollers.
+# Copyright (C) 2024 David "Alemarius Nexus" Lerch
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Tests of tools/owb_isr_cycles.py against small assembly files in the format generated by SDCC.
+
+The ISR below takes 2 cycles to _OWBMarkTimerStart, plus 4 entry cycles and whatever the test inserts before the READ0
+pull-low. The exported values are those of OWBExportValue() in interrupt.c, for builds with and without
+OWB_INT_USE_COMP. If a C compiler is found ($CC or cc), the values are also taken from interrupt.c itself, preprocessed
+for several configurations.
+"""
+
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import unittest
+
+
+FIRMWARE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..")
+TOOL = os.path.join(FIRMWARE_DIR, "tools", "owb_isr_cycles.py")
+CC = os.environ.get("CC") or shutil.which("cc")
+
+ISR = """\
+    .module interrupt
+    .area CODE
+_interrupt::
+    push    af
+    set1.io __t16m, #4
+_OWBMarkTimerStart == .
+%(exports)s
+%(read0)s
+    set0.io __pa, #0
+_OWBMarkRead0Low == .
+    set1.io __pac, #0
+00199$:
+    pop     af
+    reti
+_OWBWriteBit::
+%(write_bit)s
+    ret
+_OWBReadBit::
+    ret
+_OWBHelper::
+    nop
+    nop
+    nop
+    ret
+"""
+
+
+class IsrCyclesTest(unittest.TestCase):
+    def run_tool(self, *args, exports=("_OWBLatencyBaseTicks == 8",), read0="", write_bit=""):
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "interrupt.asm")
+            with open(path, "w") as f:
+                f.write(ISR % {"exports": "\n".join(exports), "read0": read0, "write_bit": write_bit})
+            return subprocess.run([sys.executable, TOOL, "--f-cpu", "8000000"] + list(args) + [path],
+                                  stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+
+    def test_plain(self):
+        result = self.run_tool()
+        self.assertEqual(result.returncode, 0, result.stdout)
+        self.assertRegex(result.stdout, r"Edge to T16 start\s+6 cycles.*budget\s+8 cycles")
+        self.assertRegex(result.stdout, r"Edge to READ0 pull-low\s+7 cycles")
+        self.assertNotIn("Comparator edge delay", result.stdout)
+        self.assertRegex(result.stdout, r"OWBWriteBit\(\)\s+4 cycles")
+
+    def test_comparator(self):
+        # 1000ns from Vdd to GND, reference at 0.125*Vdd: 875ns = 7 cycles at 8MHz
+        result = self.run_tool(exports=["_OWBLatencyBaseTicks == 8", "_OWBBusFallTimeNs == 1000",
+                                        "_OWBCompThresholdPermille == 125"])
+        self.assertEqual(result.returncode, 0, result.stdout)
+        self.assertRegex(result.stdout, r"Comparator edge delay\s+7 cycles")
+        self.assertRegex(result.stdout, r"Edge to T16 start\s+13 cycles.*budget\s+15 cycles")
+        self.assertRegex(result.stdout, r"Edge to READ0 pull-low\s+14 cycles")
+
+    def test_comparator_slow_edge(self):
+        # 4375ns until the reference is crossed = 35 cycles, which leaves too little of the 5us READ0 budget
+        result = self.run_tool(exports=["_OWBLatencyBaseTicks == 8", "_OWBBusFallTimeNs == 5000",
+                                        "_OWBCompThresholdPermille == 125"])
+        self.assertEqual(result.returncode, 1, result.stdout)
+        self.assertRegex(result.stdout, r"Edge to READ0 pull-low\s+42 cycles.*EXCEEDED")
+
+    def test_threshold_missing(self):
+        result = self.run_tool(exports=["_OWBLatencyBaseTicks == 8", "_OWBBusFallTimeNs == 1000"])
+        self.assertEqual(result.returncode, 2, result.stdout)
+        self.assertIn("_OWBCompThresholdPermille not exported", result.stdout)
+
+    def test_latency_exceeded(self):
+        result = self.run_tool(exports=["_OWBLatencyBaseTicks == 5"])
+        self.assertEqual(result.returncode, 1, result.stdout)
+        self.assertRegex(result.stdout, r"Edge to T16 start.*EXCEEDED")
+
+    def test_expression_not_exported(self):
+        # OWBExportValue() needs a plain number, anything else isn't recognized
+        result = self.run_tool(exports=["_OWBLatencyBaseTicks == (8 + 0)"])
+        self.assertEqual(result.returncode, 2, result.stdout)
+        self.assertIn("_OWBLatencyBaseTicks not exported", result.stdout)
+
+    def test_skip(self):
+        # READ0 is only reached if t0sn.io skips the goto, which takes 2 cycles instead of 1
+        result = self.run_tool(read0="    t0sn.io __intrq, #0\n    goto 00199$")
+        self.assertEqual(result.returncode, 0, result.stdout)
+        self.assertRegex(result.stdout, r"Edge to READ0 pull-low\s+9 cycles")
+
+    def test_jump_table(self):
+        # Every goto after pcadd is a possible successor, and the longer one (through both nops) counts
+        result = self.run_tool(read0="    mov     a, _OWBLLState\n    pcadd   a\n    goto 00110$\n    goto 00111$\n"
+                                     "00110$:\n    nop\n    nop\n00111$:")
+        self.assertEqual(result.returncode, 0, result.stdout)
+        self.assertRegex(result.stdout, r"Edge to READ0 pull-low\s+14 cycles")
+
+    def test_call(self):
+        # Calls include the whole callee: 2 for the call, 3 nops and 2 for its ret
+        result = self.run_tool(read0="    call    _OWBHelper", write_bit="    call    _OWBHelper")
+        self.assertEqual(result.returncode, 0, result.stdout)
+        self.assertRegex(result.stdout, r"Edge to READ0 pull-low\s+14 cycles")
+        self.assertRegex(result.stdout, r"OWBWriteBit\(\)\s+11 cycles")
+
+    def test_bus_switch(self):
+        # The call to _OWBHelper behind _OWBMarkBusSwitch only counts for READ0 after switch, with its own budget
+        read0 = "    t0sn.io __intrq, #0\n    goto 00130$\n_OWBMarkBusSwitch == .\n    call    _OWBHelper\n00130$:"
+        result = self.run_tool(read0=read0)
+        self.assertEqual(result.returncode, 0, result.stdout)
+        self.assertRegex(result.stdout, r"Edge to READ0 pull-low\s+10 cycles")
+        self.assertRegex(result.stdout, r"Edge to READ0 after switch\s+16 cycles.*budget\s+120 cycles")
+        result = self.run_tool("--read0-switch-budget-us", "1", read0=read0)
+        self.assertEqual(result.returncode, 1, result.stdout)
+        self.assertRegex(result.stdout, r"Edge to READ0 after switch.*EXCEEDED")
+        self.assertNotRegex(result.stdout, r"Edge to READ0 pull-low.*EXCEEDED")
+
+    def test_handler_exceeded(self):
+        # 1us are 8 cycles at 8MHz
+        result = self.run_tool("--handler-budget-us", "1", write_bit="    call    _OWBHelper")
+        self.assertEqual(result.returncode, 1, result.stdout)
+        self.assertRegex(result.stdout, r"OWBWriteBit\(\)\s+11 cycles.*budget\s+8 cycles.*EXCEEDED")
+        self.assertNotRegex(result.stdout, r"OWBReadBit\(\).*EXCEEDED")
+
+    def test_loop(self):
+        # Busy-wait loops must not be on the path to READ0
+        result = self.run_tool(read0="00120$:\n    t1sn.io __pa, #0\n    goto 00120$")
+        self.assertEqual(result.returncode, 2, result.stdout)
+        self.assertIn("loop", result.stdout)
+
+    @unittest.skipUnless(CC, "no C compiler found")
+    def test_firmware_exports(self):
+        for defines in ([], ["OWB_INT_USE_COMP"], ["OWB_POLLING_MODE"], ["OWB_SECOND_BUS_ENABLED"]):
+            with self.subTest(defines=defines):
+                result = subprocess.run([CC, "-E", "-P", "-DF_CPU=8000000", "-I" + FIRMWARE_DIR,
+                                         "-I" + os.path.join(FIRMWARE_DIR, "host", "include")]
+                                        + ["-D" + d for d in defines] + [os.path.join(FIRMWARE_DIR, "interrupt.c")],
+                                        stdout=subprocess.PIPE, universal_newlines=True)
+                self.assertEqual(result.returncode, 0)
+                values = dict(re.findall(r'__asm__\("_OWB" "(\w+)" " == " "([^"]*)" "\\n"\)', result.stdout))
+                self.assertEqual(len(values), 3 if "OWB_INT_USE_COMP" in defines else 1, values)
+                for name, value in values.items():
+                    self.assertRegex(value, r"^(\d+|0x[0-9a-fA-F]+)$", "_OWB%s is not a plain number" % name)
+                # The ISR takes 2 cycles until T16 starts, so the entry cycles fill the rest of the budget
+                result = self.run_tool("--entry-cycles", str(int(values["LatencyBaseTicks"], 0) - 2),
+                                       exports=["_OWB%s == %s" % item for item in values.items()])
+                self.assertEqual(result.returncode, 0, result.stdout)
+
+
+if __name__ == "__main__":
+    unittest.main()